@@ -0,0 +1,52 @@
+//
+// Created by lwj on 2020/3/4.
+//
+
+#ifndef KCPTUNNEL_BATCH_RECEIVER_H
+#define KCPTUNNEL_BATCH_RECEIVER_H
+
+#include <cstdint>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "ikcp.h"
+#include "fec_decode.h"
+#include "noncopyable.h"
+
+namespace kcptunnel {
+
+///drains the udp socket with recvmmsg into a fixed ring of datagram buffers
+///and hands everything fec decodes from one batch to kcp in a single
+///ikcp_input_batch, so ack/rtt/cwnd work and the ack flush happen once per
+///batch instead of once per packet
+///the ring buffers come from the pool of fec_decoder, which keeps the shards in
+///the buffers they were received into and hands kcp views of them, so a datagram
+///is neither copied nor allocated for on its way to kcp
+class BatchReceiver : noncopyable {
+ public:
+  BatchReceiver(const int32_t &socket_fd, SingleThreadFecDecode *fec_decoder);
+  ~BatchReceiver();
+  ///receive up to kBatchSize datagrams without blocking, returns the number received
+  int32_t Receive();
+  ///feed the received datagrams to fec_decoder, drain everything it prepared in one
+  ///pass and hand it to kcp, returns the number of packets kcp accepted
+  int32_t DecodeAndInput(ikcpcb *kcp);
+  ///source address of the newest datagram of the last Receive, false if none
+  bool LastPeer(sockaddr_in &addr, socklen_t &slen) const;
+ private:
+  static const int32_t kBatchSize = 32;
+  int32_t socket_fd_;
+  SingleThreadFecDecode *fec_decoder_;
+  int32_t received_ = 0;
+  ///buffers of the fec_decoder_ pool, swapped by FecDecode::InputBuffer for those it keeps
+  std::vector<char *> datagrams_;
+  std::vector<struct iovec> datagram_iovs_;
+  std::vector<sockaddr_in> addrs_;
+  std::vector<struct mmsghdr> msgs_;
+  ///views of the decoded kcp packets of one batch
+  std::vector<struct iovec> decoded_iovs_;
+};
+
+}
+
+#endif //KCPTUNNEL_BATCH_RECEIVER_H
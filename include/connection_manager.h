@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <memory>
 #include <cstdint>
+#include <sys/uio.h>
 #include "kcptunnel_common.h"
 
 namespace kcptunnel {
@@ -20,9 +21,13 @@ class ConnectionManager {
       return outside_connectionfd_2connid_.count(connection_fd);
   }
  private:
-  int32_t SendDataToRemote();
+  ///writes data_len payload bytes that follow the kcptunnel header in segs
+  int32_t SendDataToRemote(const uint32_t &conn_id, const struct iovec *segs, const int32_t &seg_count,
+                           const uint16_t &data_len);
  private:
   const int16_t header_len_ = 6;
+  ///upper bound of kcp segments one kcptunnel message may span
+  static const int32_t kMaxPeekSegments = 128;
  private:
   ///just for kcptunnel client, kcptunnel server does not get data from socket
   int32_t local_listen_fd_;
@@ -31,8 +36,8 @@ class ConnectionManager {
   ///for tcptun_server remote server info is the info of another outside server
   ip_port_t remote_server_info_;
   void *user_data_;
-  char recv_buf_[4096] = {};
-  int32_t recv_len_ = 0;
+  ///payload read from outside connections, the kcptunnel header is prepended by ikcp_sendv
+  char send_buf_[4096 - 6] = {};
   ///outside connections, for tcptun_client outside connections are connections from its clients
   ///for tcptun_server outside connections are connections from its server
   ///for both client and server value is conn_id that identify the connection
@@ -8,22 +8,80 @@
 #include "kcptunnel_common.h"
 #include "fec_encode.h"
 #include "fec_decode.h"
+#include "fec_window_encode.h"
 #include <memory>
+#include <vector>
 #include <thread>
 
 namespace kcptunnel {
 
-class FecEncodeManager {
+/**
+ * @tparam Lock lock policy of the manager and of the encoders it drives, std::mutex when
+ * Input and the flush timer run on different threads, NullLock when one event loop does
+ * everything, see the FecEncodeManager and SingleThreadFecEncodeManager typedefs
+ */
+template<typename Lock>
+class FecEncodeManagerT {
  public:
-  FecEncodeManager(std::shared_ptr<connection_info_t> sp_conn, std::shared_ptr<FecEncode> sp_fec_encoder);
+  ///with sp_window_encoder set packets go through the sliding window code instead of
+  ///the fec groups of sp_fec_encoder
+  FecEncodeManagerT(std::shared_ptr<connection_info_t> sp_conn, std::shared_ptr<FecEncodeT<Lock>> sp_fec_encoder,
+                    std::shared_ptr<FecWindowEncodeT<Lock>> sp_window_encoder = nullptr);
+  ///packets from ikcp_output, only those carrying data go into fec groups, see @func SetControlCopies
   int32_t Input(const char *data, const int32_t &length);
+  /**
+   * kcp packets made only of ack, wask and wins segments are tiny and latency critical,
+   * they are sent unencoded copies times instead of waiting for their fec group
+   * @param copies 0 puts them into fec groups like any other packet
+   */
+  void SetControlCopies(const int32_t &copies);
+  ///see FecEncode::FecEncodeUpdateTime, of whichever encoder is in use
+  int32_t FecEncodeUpdateTime(const uint64_t &cur_millsec);
   int32_t FlushUnEncodedData();
+  /**
+   * flushes open groups right at their deadline instead of on the next FecEncodeUpdateTime
+   * @param timer_fd a CLOCK_MONOTONIC timerfd watched by the event loop, armed after
+   * every Input for the earliest deadline of the encoder, call @func OnFlushTimer when
+   * it is readable
+   */
+  void SetFlushTimer(const int32_t &timer_fd);
+  int32_t OnFlushTimer(const uint64_t &cur_millsec);
+  ///sends the loss report of fec_decoder to the peer when one is due
+  int32_t SendFeedback(FecDecodeT<Lock> *fec_decoder, const uint64_t &cur_millsec);
+  ///a loss report of the peer, retunes whichever encoder is in use
+  void OnFeedback(const FecFeedback &feedback);
+  ///true when none of the kcp segments in data carries user data
+  static bool IsControlOnly(const char *data, const int32_t &length);
  private:
   int32_t send_data(const char *data, const int32_t &length);
+  int32_t SendControl(const char *data, const int32_t &length);
+  template<typename Encoder>
+  int32_t EncodeAndSend(Encoder *encoder, const char *data, const int32_t &length);
+  int32_t SendPkgs();
+  ///FlushUnEncodedData with mutex_ held
+  int32_t Flush();
+  ///(re)arms the flush timer when the earliest deadline of the encoder moved up
+  int32_t ArmFlushTimer();
  private:
   std::shared_ptr<connection_info_t> sp_conn_;
-  std::shared_ptr<FecEncode> sp_fec_encoder_;
+  std::shared_ptr<FecEncodeT<Lock>> sp_fec_encoder_;
+  std::shared_ptr<FecWindowEncodeT<Lock>> sp_window_encoder_;
+  ///guards the buffers and the flush timer state below
+  Lock mutex_;
+  ///reused by every Output/FlushUnEncodedData call
+  std::vector<char *> data_pkgs_;
+  std::vector<int32_t> data_pkgs_length_;
+  int32_t control_copies_;
+  ///control packet behind the unencoded data header
+  std::vector<char> control_pkg_;
+  int32_t flush_timer_fd_;
+  ///deadline the flush timer is armed for, -1 if it is not
+  int64_t flush_deadline_ms_;
 };
+
+///instantiated in fec_manager.cpp for these two only
+typedef FecEncodeManagerT<std::mutex> FecEncodeManager;
+typedef FecEncodeManagerT<NullLock> SingleThreadFecEncodeManager;
 }
 
 #endif //KCPTUNNEL_FEC_MANAGER_H
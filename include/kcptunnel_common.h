@@ -53,6 +53,9 @@ uint32_t read_u16(const char *p);
 
 int64_t getnowtime_ms();
 
+///monotonic clock, same clock as the CLOCK_MONOTONIC timerfds
+int64_t getnowtime_us();
+
 }
 
 #endif //TCPTUN_TCPTUN_COMMON_H
@@ -0,0 +1,54 @@
+//
+// Created by lwj on 2020/3/2.
+//
+
+#ifndef KCPTUNNEL_OUTPUT_PACER_H
+#define KCPTUNNEL_OUTPUT_PACER_H
+
+#include <cstdint>
+#include <vector>
+#include "ikcp.h"
+#include "fec_manager.h"
+
+namespace kcptunnel {
+
+///sits between ikcp_output and FecEncodeManager, instead of handing the whole
+///window to the encoder at once on every ikcp_flush it releases packets at
+///ikcp_pacing_rate through a token bucket, timer_fd(a CLOCK_MONOTONIC timerfd
+///watched by the event loop) wakes us up when the next packet is due
+///every packet kcp flushes is accepted, once max_queued_pkgs wait kcp is held with
+///ikcp_sndhold so no new data enters its send window until half of them drained
+///packets made only of ack, wask and wins segments are not paced, they go out ahead of
+///the queued data at once
+class OutputPacer {
+ public:
+  OutputPacer(ikcpcb *kcp, SingleThreadFecEncodeManager *fec_encode_manager, const int32_t &timer_fd,
+              const size_t &max_queued_pkgs = 1024);
+  ///queue one packet from ikcp_output, sends it at once if the bucket allows
+  int32_t Input(const char *data, const int32_t &length);
+  ///call it when timer_fd is readable
+  int32_t OnTimer();
+ private:
+  int32_t Release();
+  int32_t ArmTimer(const int64_t &delay_us);
+ private:
+  ///bucket depth never goes below two full packets
+  const int64_t min_burst_bytes_ = 2 * 1500;
+  const size_t max_queued_pkgs_;
+  ikcpcb *kcp_;
+  SingleThreadFecEncodeManager *fec_encode_manager_;
+  int32_t timer_fd_;
+  bool timer_armed_ = false;
+  ///kcp is held by ikcp_sndhold
+  bool kcp_held_ = false;
+  double tokens_ = 0;
+  int64_t last_refill_us_ = 0;
+  ///ring of queued packets, slots keep their capacity so steady state does not allocate
+  std::vector<std::vector<char>> slots_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+};
+
+}
+
+#endif //KCPTUNNEL_OUTPUT_PACER_H
@@ -17,6 +17,49 @@ struct system_config_t {
   int32_t listen_port;
   std::string remote_ip;
   int32_t remote_port;
+  ///optional, "classic"(default) or "bbr"
+  std::string congestion_control;
+  ///optional, default false, single parity fec groups use xor instead of reed-solomon,
+  ///only set it when the peer understands the extended fec header
+  bool fec_xor_parity;
+  ///optional, default true, retune the fec group shape, or the repair interval of the
+  ///window mode, from the peer's loss feedback, set false when the peer does not send feedback or does not understand it
+  bool fec_adaptive;
+  ///optional, default 1(off), consecutive packages are spread over this many fec groups
+  ///to survive burst loss, at most 8
+  int32_t fec_interleave;
+  ///optional, default 100, interleaving is reduced so that a group still completes within it
+  int32_t fec_latency_budget_ms;
+  ///optional, "block"(default) fec groups or "window" for the sliding window code,
+  ///whose repair packets cover the last fec_window packages so recovery never waits
+  ///for a group to fill
+  std::string fec_mode;
+  ///optional, default 16, packages covered by a repair packet of the window mode, at most 32
+  int32_t fec_window;
+  ///optional, default 4, the window mode sends a repair packet after this many packages
+  int32_t fec_window_interval;
+  ///optional, default 30, an open fec group is closed with parity over the packages it
+  ///has got this many milliseconds after its first one
+  int32_t fec_flush_deadline_ms;
+  ///optional, default 128(0 means off), packages up to this length such as kcp acks are
+  ///fec grouped apart from full sized data, so their parity is not padded to the mss
+  int32_t fec_small_class_max_length;
+  ///optional, default 30, the same deadline for the groups of small packages
+  int32_t fec_small_class_deadline_ms;
+  ///optional, default 2, kcp packets with only acks and window probes skip fec and are
+  ///sent this many times, 0 fec encodes them like data
+  int32_t fec_control_copies;
+  ///optional, default 2 and 1, the fec group shape (k, m), which fec_adaptive replaces
+  ///after the first loss report, k + m is at most 255
+  int32_t fec_data_shards;
+  int32_t fec_parity_shards;
+  ///optional, "rs"(default) vandermonde reed-solomon over GF(2^8) or "gf16" the FFT
+  ///based code over GF(2^16), whose cost grows O(n log n) instead of O(k * m) and
+  ///pays off for large groups such as 200 + 40, both ends need to support it
+  std::string fec_codec;
+  ///optional, default false, every fec shard carries a crc32c so a corrupted one is
+  ///repaired by fec like a lost one, the peer has to understand the crc flag
+  bool fec_crc;
   bool parse_flag;
 };
 
@@ -16,6 +16,15 @@
 #include <stdlib.h>
 #include <assert.h>
 
+#if defined(_WIN32) || defined(WIN32)
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+#endif
+
 
 //=====================================================================
 // 32BIT INTEGER DEFINITION 
@@ -279,10 +288,49 @@ struct IKCPSEG
 	IUINT32 rto;
 	IUINT32 fastack;
 	IUINT32 xmit;
+	IUINT32 delivered;
+	IUINT32 delivered_ts;
+	IUINT32 cap;
 	char data[1];
 };
 
 
+//---------------------------------------------------------------------
+// CONGESTION CONTROL
+//---------------------------------------------------------------------
+struct IKCPCB;
+
+// what one ikcp_input (or ikcp_input_batch) call acknowledged, handed to on_ack
+struct IKCPACKSAMPLE
+{
+	IUINT32 current;			// kcp->current when the ack was parsed
+	IUINT32 acked;				// segments removed from snd_buf
+	IUINT32 inflight;			// segments still in flight afterwards
+	IINT32 rtt;					// newest rtt sample, -1 if none
+	IUINT32 delivered;			// kcp->delivered after this ack
+	IUINT32 prior_delivered;	// kcp->delivered when the sampled segment was sent
+	IUINT32 rate;				// delivery rate in bytes/sec, 0 if no sample
+	int una_advanced;			// snd_una moved forward
+};
+
+#define IKCP_LOSS_FAST		1	// fast retransmit triggered by fastack
+#define IKCP_LOSS_TIMEOUT	2	// retransmission timeout
+
+// congestion controller, install it with ikcp_setcc. on_send may be NULL,
+// 'cwnd' is in segments and 'pacing_rate' in bytes/sec (0: not paced)
+struct IKCPCCOPS
+{
+	const char *name;
+	int (*init)(struct IKCPCB *kcp);
+	void (*release)(struct IKCPCB *kcp);
+	void (*on_ack)(struct IKCPCB *kcp, const struct IKCPACKSAMPLE *sample);
+	void (*on_loss)(struct IKCPCB *kcp, int kind, IUINT32 cwnd);
+	void (*on_send)(struct IKCPCB *kcp, const struct IKCPSEG *seg);
+	IUINT32 (*cwnd)(const struct IKCPCB *kcp);
+	IUINT32 (*pacing_rate)(const struct IKCPCB *kcp);
+};
+
+
 //---------------------------------------------------------------------
 // IKCPCB
 //---------------------------------------------------------------------
@@ -299,6 +347,7 @@ struct IKCPCB
 	IUINT32 nodelay, updated;
 	IUINT32 ts_probe, probe_wait;
 	IUINT32 dead_link, incr;
+	IUINT32 delivered, delivered_ts;
 	struct IQUEUEHEAD snd_queue;
 	struct IQUEUEHEAD rcv_queue;
 	struct IQUEUEHEAD snd_buf;
@@ -311,7 +360,10 @@ struct IKCPCB
 	int fastresend;
 	int fastlimit;
 	int nocwnd, stream;
+	int sndhold;
 	int logmask;
+	const struct IKCPCCOPS *cc;
+	void *cc_data;
 	int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
 	void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
 };
@@ -358,6 +410,10 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len);
 // user/upper level send, returns below zero for error
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len);
 
+// gather version of ikcp_send, the iovecs are sent as one message
+// (or appended to the stream), returns below zero for error
+int ikcp_sendv(ikcpcb *kcp, const struct iovec *iov, int iovcnt);
+
 // update state (call it repeatedly, every 10ms-100ms), or you can ask 
 // ikcp_check when to call it again (without ikcp_input/_send calling).
 // 'current' - current timestamp in millisec. 
@@ -375,12 +431,25 @@ IUINT32 ikcp_check(const ikcpcb *kcp, IUINT32 current);
 // when you received a low level packet (eg. UDP packet), call it
 int ikcp_input(ikcpcb *kcp, const char *data, long size);
 
+// input a batch of low level packets, acks/una/rtt are applied once for
+// the batch and, when flush is set, one ikcp_flush sends the acks.
+// returns the number of packets accepted.
+int ikcp_input_batch(ikcpcb *kcp, const struct iovec *pkts, int count, int flush);
+
 // flush pending data
 void ikcp_flush(ikcpcb *kcp);
 
 // check the size of next message in the recv queue
 int ikcp_peeksize(const ikcpcb *kcp);
 
+// zero-copy recv: fill iov with the segments of the next message (in
+// stream mode with the queued segments), returns the iov count or
+// below zero when nothing is ready. data stays valid until consumed.
+int ikcp_peekv(const ikcpcb *kcp, struct iovec *iov, int iovcnt);
+
+// drop len bytes of peeked data, returns the number of bytes released
+int ikcp_consume(ikcpcb *kcp, int len);
+
 // change MTU size, default is 1400
 int ikcp_setmtu(ikcpcb *kcp, int mtu);
 
@@ -390,6 +459,10 @@ int ikcp_wndsize(ikcpcb *kcp, int sndwnd, int rcvwnd);
 // get how many packet is waiting to be sent
 int ikcp_waitsnd(const ikcpcb *kcp);
 
+// hold: 1 stops ikcp_flush from moving new data from snd_queue to snd_buf,
+// acks, window probes and retransmissions still go out. 0 resumes
+int ikcp_sndhold(ikcpcb *kcp, int hold);
+
 // fastest: ikcp_nodelay(kcp, 1, 20, 2, 1)
 // nodelay: 0:disable(default), 1:enable
 // interval: internal update timer interval in millisec, default is 100ms 
@@ -397,6 +470,22 @@ int ikcp_waitsnd(const ikcpcb *kcp);
 // nc: 0:normal congestion control(default), 1:disable congestion control
 int ikcp_nodelay(ikcpcb *kcp, int nodelay, int interval, int resend, int nc);
 
+// built-in congestion controllers: the loss based cwnd/ssthresh one
+// (default) and a delivery-rate/min-rtt one in the spirit of BBR
+extern const struct IKCPCCOPS ikcp_cc_classic;
+extern const struct IKCPCCOPS ikcp_cc_bbr;
+
+// find a built-in congestion controller by name ("classic", "bbr")
+const struct IKCPCCOPS* ikcp_cc_find(const char *name);
+
+// replace the congestion controller, returns below zero if its init
+// failed, the classic one is restored in that case
+int ikcp_setcc(ikcpcb *kcp, const struct IKCPCCOPS *ops);
+
+// current pacing rate in bytes/sec: the congestion controller's rate,
+// or cwnd/srtt when it has none. 0 means unpaced (no rtt sample yet)
+IUINT32 ikcp_pacing_rate(const ikcpcb *kcp);
+
 
 void ikcp_log(ikcpcb *kcp, int mask, const char *fmt, ...);
 
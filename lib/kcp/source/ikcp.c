@@ -172,7 +172,9 @@ void ikcp_allocator(void* (*new_malloc)(size_t), void (*new_free)(void*))
 // allocate a new kcp segment
 static IKCPSEG* ikcp_segment_new(ikcpcb *kcp, int size)
 {
-	return (IKCPSEG*)ikcp_malloc(sizeof(IKCPSEG) + size);
+	IKCPSEG *seg = (IKCPSEG*)ikcp_malloc(sizeof(IKCPSEG) + size);
+	if (seg) seg->cap = (IUINT32)size;
+	return seg;
 }
 
 // delete a segment
@@ -286,8 +288,13 @@ ikcpcb* ikcp_create(IUINT32 conv, void *user)
 	kcp->fastresend = 0;
 	kcp->fastlimit = IKCP_FASTACK_LIMIT;
 	kcp->nocwnd = 0;
+	kcp->sndhold = 0;
 	kcp->xmit = 0;
 	kcp->dead_link = IKCP_DEADLINK;
+	kcp->delivered = 0;
+	kcp->delivered_ts = 0;
+	kcp->cc = &ikcp_cc_classic;
+	kcp->cc_data = NULL;
 	kcp->output = NULL;
 	kcp->writelog = NULL;
 
@@ -329,6 +336,9 @@ void ikcp_release(ikcpcb *kcp)
 		if (kcp->acklist) {
 			ikcp_free(kcp->acklist);
 		}
+		if (kcp->cc && kcp->cc->release) {
+			kcp->cc->release(kcp);
+		}
 
 		kcp->nrcv_buf = 0;
 		kcp->nsnd_buf = 0;
@@ -352,6 +362,26 @@ void ikcp_setoutput(ikcpcb *kcp, int (*output)(const char *buf, int len,
 }
 
 
+//---------------------------------------------------------------------
+// move available data from rcv_buf -> rcv_queue
+//---------------------------------------------------------------------
+static void ikcp_move_rcv_buf(ikcpcb *kcp)
+{
+	while (! iqueue_is_empty(&kcp->rcv_buf)) {
+		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
+		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
+			iqueue_del(&seg->node);
+			kcp->nrcv_buf--;
+			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
+			kcp->nrcv_que++;
+			kcp->rcv_nxt++;
+		}	else {
+			break;
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // user/upper level recv: returns size, returns below zero for EAGAIN
 //---------------------------------------------------------------------
@@ -411,18 +441,7 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len)
 	assert(len == peeksize);
 
 	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
-		}
-	}
+	ikcp_move_rcv_buf(kcp);
 
 	// fast recover
 	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
@@ -435,6 +454,90 @@ int ikcp_recv(ikcpcb *kcp, char *buffer, int len)
 }
 
 
+//---------------------------------------------------------------------
+// zero-copy recv: map the segments of the next message (stream mode:
+// the queued segments) into iov, the memory stays owned by kcp until
+// ikcp_consume. returns the number of iovecs filled, -1 when no full
+// message is ready and -2 when iovcnt is too small for the message.
+//---------------------------------------------------------------------
+int ikcp_peekv(const ikcpcb *kcp, struct iovec *iov, int iovcnt)
+{
+	const struct IQUEUEHEAD *p;
+	const IKCPSEG *seg;
+	int count = 0;
+
+	assert(kcp);
+
+	if (iqueue_is_empty(&kcp->rcv_queue)) return -1;
+
+	seg = iqueue_entry(kcp->rcv_queue.next, IKCPSEG, node);
+	if (kcp->stream == 0) {
+		if (kcp->nrcv_que < seg->frg + 1) return -1;
+		if (iovcnt < (int)seg->frg + 1) return -2;
+	}
+
+	for (p = kcp->rcv_queue.next; p != &kcp->rcv_queue; p = p->next) {
+		if (count >= iovcnt) break;
+		seg = iqueue_entry(p, IKCPSEG, node);
+		iov[count].iov_base = (void*)seg->data;
+		iov[count].iov_len = seg->len;
+		count++;
+		if (kcp->stream == 0 && seg->frg == 0) break;
+	}
+
+	return count;
+}
+
+
+//---------------------------------------------------------------------
+// release len bytes from the front of rcv_queue after ikcp_peekv,
+// a partly consumed segment keeps its remainder at the front.
+// returns the number of bytes released.
+//---------------------------------------------------------------------
+int ikcp_consume(ikcpcb *kcp, int len)
+{
+	int recover = 0, consumed = 0;
+
+	assert(kcp);
+
+	if (len <= 0) return 0;
+
+	if (kcp->nrcv_que >= kcp->rcv_wnd)
+		recover = 1;
+
+	while (consumed < len && ! iqueue_is_empty(&kcp->rcv_queue)) {
+		IKCPSEG *seg = iqueue_entry(kcp->rcv_queue.next, IKCPSEG, node);
+		int remain = len - consumed;
+
+		if ((int)seg->len > remain) {
+			memmove(seg->data, seg->data + remain, seg->len - remain);
+			seg->len -= remain;
+			consumed += remain;
+			break;
+		}
+
+		if (ikcp_canlog(kcp, IKCP_LOG_RECV)) {
+			ikcp_log(kcp, IKCP_LOG_RECV, "recv sn=%lu", seg->sn);
+		}
+
+		consumed += seg->len;
+		iqueue_del(&seg->node);
+		ikcp_segment_delete(kcp, seg);
+		kcp->nrcv_que--;
+	}
+
+	// move available data from rcv_buf -> rcv_queue
+	ikcp_move_rcv_buf(kcp);
+
+	// fast recover
+	if (kcp->nrcv_que < kcp->rcv_wnd && recover) {
+		kcp->probe |= IKCP_ASK_TELL;
+	}
+
+	return consumed;
+}
+
+
 //---------------------------------------------------------------------
 // peek data size
 //---------------------------------------------------------------------
@@ -463,40 +566,93 @@ int ikcp_peeksize(const ikcpcb *kcp)
 }
 
 
+//---------------------------------------------------------------------
+// gather cursor for ikcp_sendv, a NULL iov_base reserves space
+// without copying (like ikcp_send with a NULL buffer)
+//---------------------------------------------------------------------
+typedef struct IKCPIOVCUR
+{
+	const struct iovec *iov;
+	int iovcnt;
+	size_t offset;
+}	IKCPIOVCUR;
+
+static void ikcp_iovcur_copy(IKCPIOVCUR *cur, char *dst, int size)
+{
+	while (size > 0 && cur->iovcnt > 0) {
+		size_t avail = cur->iov->iov_len - cur->offset;
+		size_t n = ((size_t)size < avail)? (size_t)size : avail;
+		if (cur->iov->iov_base) {
+			memcpy(dst, (const char*)cur->iov->iov_base + cur->offset, n);
+		}
+		dst += n;
+		size -= (int)n;
+		cur->offset += n;
+		if (cur->offset == cur->iov->iov_len) {
+			cur->iov++;
+			cur->iovcnt--;
+			cur->offset = 0;
+		}
+	}
+}
+
+
 //---------------------------------------------------------------------
 // user/upper level send, returns below zero for error
 //---------------------------------------------------------------------
 int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
+{
+	struct iovec vec;
+	if (len < 0) return -1;
+	vec.iov_base = (void*)buffer;
+	vec.iov_len = (size_t)len;
+	return ikcp_sendv(kcp, &vec, 1);
+}
+
+int ikcp_sendv(ikcpcb *kcp, const struct iovec *iov, int iovcnt)
 {
 	IKCPSEG *seg;
-	int count, i;
+	IKCPIOVCUR cur;
+	int count, i, len = 0;
 
 	assert(kcp->mss > 0);
-	if (len < 0) return -1;
+	if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) return -1;
 
-	// append to previous segment in streaming mode (if possible)
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].iov_len > (size_t)0x7fffffff - (size_t)len) return -1;
+		len += (int)iov[i].iov_len;
+	}
+
+	cur.iov = iov;
+	cur.iovcnt = iovcnt;
+	cur.offset = 0;
+
+	// append to previous segment in streaming mode (if possible), stream
+	// segments are allocated at mss so this is an in-place copy
 	if (kcp->stream != 0) {
 		if (!iqueue_is_empty(&kcp->snd_queue)) {
 			IKCPSEG *old = iqueue_entry(kcp->snd_queue.prev, IKCPSEG, node);
 			if (old->len < kcp->mss) {
 				int capacity = kcp->mss - old->len;
 				int extend = (len < capacity)? len : capacity;
-				seg = ikcp_segment_new(kcp, old->len + extend);
-				assert(seg);
-				if (seg == NULL) {
-					return -2;
-				}
-				iqueue_add_tail(&seg->node, &kcp->snd_queue);
-				memcpy(seg->data, old->data, old->len);
-				if (buffer) {
-					memcpy(seg->data + old->len, buffer, extend);
-					buffer += extend;
+				if (old->len + extend > old->cap) {
+					// allocated before an mtu change, move it to a full one
+					seg = ikcp_segment_new(kcp, kcp->mss);
+					assert(seg);
+					if (seg == NULL) {
+						return -2;
+					}
+					memcpy(seg->data, old->data, old->len);
+					seg->len = old->len;
+					seg->frg = 0;
+					iqueue_add_tail(&seg->node, &kcp->snd_queue);
+					iqueue_del_init(&old->node);
+					ikcp_segment_delete(kcp, old);
+					old = seg;
 				}
-				seg->len = old->len + extend;
-				seg->frg = 0;
+				ikcp_iovcur_copy(&cur, old->data + old->len, extend);
+				old->len += extend;
 				len -= extend;
-				iqueue_del_init(&old->node);
-				ikcp_segment_delete(kcp, old);
 			}
 		}
 		if (len <= 0) {
@@ -514,22 +670,19 @@ int ikcp_send(ikcpcb *kcp, const char *buffer, int len)
 	// fragment
 	for (i = 0; i < count; i++) {
 		int size = len > (int)kcp->mss ? (int)kcp->mss : len;
-		seg = ikcp_segment_new(kcp, size);
+		seg = ikcp_segment_new(kcp, (kcp->stream != 0)? (int)kcp->mss : size);
 		assert(seg);
 		if (seg == NULL) {
 			return -2;
 		}
-		if (buffer && len > 0) {
-			memcpy(seg->data, buffer, size);
+		if (len > 0) {
+			ikcp_iovcur_copy(&cur, seg->data, size);
 		}
 		seg->len = size;
 		seg->frg = (kcp->stream == 0)? (count - i - 1) : 0;
 		iqueue_init(&seg->node);
 		iqueue_add_tail(&seg->node, &kcp->snd_queue);
 		kcp->nsnd_que++;
-		if (buffer) {
-			buffer += size;
-		}
 		len -= size;
 	}
 
@@ -568,7 +721,30 @@ static void ikcp_shrink_buf(ikcpcb *kcp)
 	}
 }
 
-static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
+// account an acknowledged segment for delivery rate sampling, only
+// segments sent once give an unambiguous sample (Karn)
+static void ikcp_ack_segment(ikcpcb *kcp, IKCPSEG *seg, 
+	struct IKCPACKSAMPLE *sample)
+{
+	kcp->delivered += seg->len + IKCP_OVERHEAD;
+	kcp->delivered_ts = kcp->current;
+	sample->acked++;
+	if (seg->xmit == 1 && (sample->rate == 0 || 
+		_itimediff(seg->delivered, sample->prior_delivered) > 0)) {
+		IINT32 interval = _itimediff(kcp->current, seg->delivered_ts);
+		IUINT64 bytes = kcp->delivered - seg->delivered;
+		if (interval < 1) interval = 1;
+		sample->prior_delivered = seg->delivered;
+		sample->rate = (IUINT32)(bytes * 1000 / (IUINT32)interval);
+		if (sample->rate == 0) sample->rate = 1;
+	}
+	iqueue_del(&seg->node);
+	ikcp_segment_delete(kcp, seg);
+	kcp->nsnd_buf--;
+}
+
+static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn, 
+	struct IKCPACKSAMPLE *sample)
 {
 	struct IQUEUEHEAD *p, *next;
 
@@ -579,9 +755,7 @@ static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
 		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
 		next = p->next;
 		if (sn == seg->sn) {
-			iqueue_del(p);
-			ikcp_segment_delete(kcp, seg);
-			kcp->nsnd_buf--;
+			ikcp_ack_segment(kcp, seg, sample);
 			break;
 		}
 		if (_itimediff(sn, seg->sn) < 0) {
@@ -590,16 +764,15 @@ static void ikcp_parse_ack(ikcpcb *kcp, IUINT32 sn)
 	}
 }
 
-static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una)
+static void ikcp_parse_una(ikcpcb *kcp, IUINT32 una, 
+	struct IKCPACKSAMPLE *sample)
 {
 	struct IQUEUEHEAD *p, *next;
 	for (p = kcp->snd_buf.next; p != &kcp->snd_buf; p = next) {
 		IKCPSEG *seg = iqueue_entry(p, IKCPSEG, node);
 		next = p->next;
 		if (_itimediff(una, seg->sn) > 0) {
-			iqueue_del(p);
-			ikcp_segment_delete(kcp, seg);
-			kcp->nsnd_buf--;
+			ikcp_ack_segment(kcp, seg, sample);
 		}	else {
 			break;
 		}
@@ -718,18 +891,7 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 #endif
 
 	// move available data from rcv_buf -> rcv_queue
-	while (! iqueue_is_empty(&kcp->rcv_buf)) {
-		IKCPSEG *seg = iqueue_entry(kcp->rcv_buf.next, IKCPSEG, node);
-		if (seg->sn == kcp->rcv_nxt && kcp->nrcv_que < kcp->rcv_wnd) {
-			iqueue_del(&seg->node);
-			kcp->nrcv_buf--;
-			iqueue_add_tail(&seg->node, &kcp->rcv_queue);
-			kcp->nrcv_que++;
-			kcp->rcv_nxt++;
-		}	else {
-			break;
-		}
-	}
+	ikcp_move_rcv_buf(kcp);
 
 #if 0
 	ikcp_qprint("queue", &kcp->rcv_queue);
@@ -744,19 +906,34 @@ void ikcp_parse_data(ikcpcb *kcp, IKCPSEG *newseg)
 
 
 //---------------------------------------------------------------------
-// input data
+// input state shared by ikcp_input and ikcp_input_batch, in deferred
+// mode una and rtt are folded across packets and applied once
 //---------------------------------------------------------------------
-int ikcp_input(ikcpcb *kcp, const char *data, long size)
+typedef struct IKCPINPUTCTX
 {
-	IUINT32 prev_una = kcp->snd_una;
-	IUINT32 maxack = 0, latest_ts = 0;
-	int flag = 0;
-
-	if (ikcp_canlog(kcp, IKCP_LOG_INPUT)) {
-		ikcp_log(kcp, IKCP_LOG_INPUT, "[RI] %d bytes", size);
-	}
+	struct IKCPACKSAMPLE sample;
+	IUINT32 prev_una;
+	IUINT32 maxack, latest_ts;
+	int flag;
+	int deferred;
+	IUINT32 una;
+	IUINT32 rtt_ts;
+	int has_rtt;
+}	IKCPINPUTCTX;
+
+static void ikcp_input_begin(ikcpcb *kcp, IKCPINPUTCTX *ctx, int deferred)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->sample.rtt = -1;
+	ctx->prev_una = kcp->snd_una;
+	ctx->deferred = deferred;
+	ctx->una = kcp->snd_una;
+}
 
-	if (data == NULL || (int)size < (int)IKCP_OVERHEAD) return -1;
+static int ikcp_input_parse(ikcpcb *kcp, IKCPINPUTCTX *ctx, 
+	const char *data, long size)
+{
+	struct IKCPACKSAMPLE *sample = &ctx->sample;
 
 	while (1) {
 		IUINT32 ts, sn, len, una, conv;
@@ -786,28 +963,41 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 			return -3;
 
 		kcp->rmt_wnd = wnd;
-		ikcp_parse_una(kcp, una);
-		ikcp_shrink_buf(kcp);
+		if (ctx->deferred == 0) {
+			ikcp_parse_una(kcp, una, sample);
+			ikcp_shrink_buf(kcp);
+		}
+		else if (_itimediff(una, ctx->una) > 0) {
+			ctx->una = una;
+		}
 
 		if (cmd == IKCP_CMD_ACK) {
 			if (_itimediff(kcp->current, ts) >= 0) {
-				ikcp_update_ack(kcp, _itimediff(kcp->current, ts));
+				if (ctx->deferred == 0) {
+					sample->rtt = _itimediff(kcp->current, ts);
+					ikcp_update_ack(kcp, sample->rtt);
+				}
+				else if (ctx->has_rtt == 0 || 
+					_itimediff(ts, ctx->rtt_ts) > 0) {
+					ctx->has_rtt = 1;
+					ctx->rtt_ts = ts;
+				}
 			}
-			ikcp_parse_ack(kcp, sn);
+			ikcp_parse_ack(kcp, sn, sample);
 			ikcp_shrink_buf(kcp);
-			if (flag == 0) {
-				flag = 1;
-				maxack = sn;
-				latest_ts = ts;
+			if (ctx->flag == 0) {
+				ctx->flag = 1;
+				ctx->maxack = sn;
+				ctx->latest_ts = ts;
 			}	else {
-				if (_itimediff(sn, maxack) > 0) {
+				if (_itimediff(sn, ctx->maxack) > 0) {
 				#ifndef IKCP_FASTACK_CONSERVE
-					maxack = sn;
-					latest_ts = ts;
+					ctx->maxack = sn;
+					ctx->latest_ts = ts;
 				#else
-					if (_itimediff(ts, latest_ts) > 0) {
-						maxack = sn;
-						latest_ts = ts;
+					if (_itimediff(ts, ctx->latest_ts) > 0) {
+						ctx->maxack = sn;
+						ctx->latest_ts = ts;
 					}
 				#endif
 				}
@@ -868,34 +1058,102 @@ int ikcp_input(ikcpcb *kcp, const char *data, long size)
 		size -= len;
 	}
 
-	if (flag != 0) {
-		ikcp_parse_fastack(kcp, maxack, latest_ts);
-	}
+	return 0;
+}
 
-	if (_itimediff(kcp->snd_una, prev_una) > 0) {
-		if (kcp->cwnd < kcp->rmt_wnd) {
-			IUINT32 mss = kcp->mss;
-			if (kcp->cwnd < kcp->ssthresh) {
-				kcp->cwnd++;
-				kcp->incr += mss;
-			}	else {
-				if (kcp->incr < mss) kcp->incr = mss;
-				kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
-				if ((kcp->cwnd + 1) * mss <= kcp->incr) {
-					kcp->cwnd++;
-				}
-			}
-			if (kcp->cwnd > kcp->rmt_wnd) {
-				kcp->cwnd = kcp->rmt_wnd;
-				kcp->incr = kcp->rmt_wnd * mss;
-			}
+static void ikcp_input_end(ikcpcb *kcp, IKCPINPUTCTX *ctx)
+{
+	struct IKCPACKSAMPLE *sample = &ctx->sample;
+
+	if (ctx->deferred) {
+		ikcp_parse_una(kcp, ctx->una, sample);
+		ikcp_shrink_buf(kcp);
+		if (ctx->has_rtt) {
+			sample->rtt = _itimediff(kcp->current, ctx->rtt_ts);
+			ikcp_update_ack(kcp, sample->rtt);
 		}
 	}
 
+	if (ctx->flag != 0) {
+		ikcp_parse_fastack(kcp, ctx->maxack, ctx->latest_ts);
+	}
+
+	sample->una_advanced = (_itimediff(kcp->snd_una, ctx->prev_una) > 0);
+
+	if (sample->acked > 0 || sample->una_advanced) {
+		sample->current = kcp->current;
+		sample->inflight = kcp->snd_nxt - kcp->snd_una;
+		sample->delivered = kcp->delivered;
+		kcp->cc->on_ack(kcp, sample);
+	}
+}
+
+
+//---------------------------------------------------------------------
+// input data
+//---------------------------------------------------------------------
+int ikcp_input(ikcpcb *kcp, const char *data, long size)
+{
+	IKCPINPUTCTX ctx;
+	int hr;
+
+	if (ikcp_canlog(kcp, IKCP_LOG_INPUT)) {
+		ikcp_log(kcp, IKCP_LOG_INPUT, "[RI] %d bytes", size);
+	}
+
+	if (data == NULL || (int)size < (int)IKCP_OVERHEAD) return -1;
+
+	ikcp_input_begin(kcp, &ctx, 0);
+
+	hr = ikcp_input_parse(kcp, &ctx, data, size);
+	if (hr < 0) return hr;
+
+	ikcp_input_end(kcp, &ctx);
+
 	return 0;
 }
 
 
+//---------------------------------------------------------------------
+// input a batch of packets: una, rtt, fastack and congestion control
+// are updated once for the whole batch, malformed packets are skipped.
+// returns the number of packets accepted.
+//---------------------------------------------------------------------
+int ikcp_input_batch(ikcpcb *kcp, const struct iovec *pkts, int count, 
+	int flush)
+{
+	IKCPINPUTCTX ctx;
+	int i, accepted = 0;
+
+	if (pkts == NULL || count <= 0) return 0;
+
+	ikcp_input_begin(kcp, &ctx, 1);
+
+	for (i = 0; i < count; i++) {
+		const char *data = (const char*)pkts[i].iov_base;
+		long size = (long)pkts[i].iov_len;
+
+		if (ikcp_canlog(kcp, IKCP_LOG_INPUT)) {
+			ikcp_log(kcp, IKCP_LOG_INPUT, "[RI] %d bytes", size);
+		}
+
+		if (data == NULL || (int)size < (int)IKCP_OVERHEAD) continue;
+
+		if (ikcp_input_parse(kcp, &ctx, data, size) == 0) {
+			accepted++;
+		}
+	}
+
+	ikcp_input_end(kcp, &ctx);
+
+	if (flush && (kcp->ackcount > 0 || kcp->probe != 0)) {
+		ikcp_flush(kcp);
+	}
+
+	return accepted;
+}
+
+
 //---------------------------------------------------------------------
 // ikcp_encode_seg
 //---------------------------------------------------------------------
@@ -1011,10 +1269,15 @@ void ikcp_flush(ikcpcb *kcp)
 
 	// calculate window size
 	cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
-	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cwnd, cwnd);
+	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cc->cwnd(kcp), cwnd);
+
+	// nothing in flight, restart the delivery rate clock
+	if (iqueue_is_empty(&kcp->snd_buf)) {
+		kcp->delivered_ts = current;
+	}
 
-	// move data from snd_queue to snd_buf
-	while (_itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) < 0) {
+	// move data from snd_queue to snd_buf, unless the output side holds it
+	while (kcp->sndhold == 0 && _itimediff(kcp->snd_nxt, kcp->snd_una + cwnd) < 0) {
 		IKCPSEG *newseg;
 		if (iqueue_is_empty(&kcp->snd_queue)) break;
 
@@ -1079,6 +1342,12 @@ void ikcp_flush(ikcpcb *kcp)
 			segment->ts = current;
 			segment->wnd = seg.wnd;
 			segment->una = kcp->rcv_nxt;
+			segment->delivered = kcp->delivered;
+			segment->delivered_ts = kcp->delivered_ts;
+
+			if (kcp->cc->on_send) {
+				kcp->cc->on_send(kcp, segment);
+			}
 
 			size = (int)(ptr - buffer);
 			need = IKCP_OVERHEAD + segment->len;
@@ -1107,22 +1376,13 @@ void ikcp_flush(ikcpcb *kcp)
 		ikcp_output(kcp, buffer, size);
 	}
 
-	// update ssthresh
+	// let the congestion controller react
 	if (change) {
-		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
-		kcp->ssthresh = inflight / 2;
-		if (kcp->ssthresh < IKCP_THRESH_MIN)
-			kcp->ssthresh = IKCP_THRESH_MIN;
-		kcp->cwnd = kcp->ssthresh + resent;
-		kcp->incr = kcp->cwnd * kcp->mss;
+		kcp->cc->on_loss(kcp, IKCP_LOSS_FAST, cwnd);
 	}
 
 	if (lost) {
-		kcp->ssthresh = cwnd / 2;
-		if (kcp->ssthresh < IKCP_THRESH_MIN)
-			kcp->ssthresh = IKCP_THRESH_MIN;
-		kcp->cwnd = 1;
-		kcp->incr = kcp->mss;
+		kcp->cc->on_loss(kcp, IKCP_LOSS_TIMEOUT, cwnd);
 	}
 
 	if (kcp->cwnd < 1) {
@@ -1281,6 +1541,12 @@ int ikcp_waitsnd(const ikcpcb *kcp)
 	return kcp->nsnd_buf + kcp->nsnd_que;
 }
 
+int ikcp_sndhold(ikcpcb *kcp, int hold)
+{
+	kcp->sndhold = hold? 1 : 0;
+	return 0;
+}
+
 
 // read conv
 IUINT32 ikcp_getconv(const void *ptr)
@@ -1291,3 +1557,402 @@ IUINT32 ikcp_getconv(const void *ptr)
 }
 
 
+
+
+//=====================================================================
+// CONGESTION CONTROL
+//=====================================================================
+
+//---------------------------------------------------------------------
+// classic: loss based cwnd/ssthresh, the original kcp behaviour
+//---------------------------------------------------------------------
+static int ikcp_classic_init(ikcpcb *kcp)
+{
+	kcp->cc_data = NULL;
+	return 0;
+}
+
+static void ikcp_classic_release(ikcpcb *kcp)
+{
+}
+
+static void ikcp_classic_on_ack(ikcpcb *kcp, 
+	const struct IKCPACKSAMPLE *sample)
+{
+	if (sample->una_advanced == 0) return;
+	if (kcp->cwnd < kcp->rmt_wnd) {
+		IUINT32 mss = kcp->mss;
+		if (kcp->cwnd < kcp->ssthresh) {
+			kcp->cwnd++;
+			kcp->incr += mss;
+		}	else {
+			if (kcp->incr < mss) kcp->incr = mss;
+			kcp->incr += (mss * mss) / kcp->incr + (mss / 16);
+			if ((kcp->cwnd + 1) * mss <= kcp->incr) {
+				kcp->cwnd++;
+			}
+		}
+		if (kcp->cwnd > kcp->rmt_wnd) {
+			kcp->cwnd = kcp->rmt_wnd;
+			kcp->incr = kcp->rmt_wnd * mss;
+		}
+	}
+}
+
+static void ikcp_classic_on_loss(ikcpcb *kcp, int kind, IUINT32 cwnd)
+{
+	if (kind == IKCP_LOSS_FAST) {
+		IUINT32 inflight = kcp->snd_nxt - kcp->snd_una;
+		IUINT32 resent = (kcp->fastresend > 0)? 
+			(IUINT32)kcp->fastresend : 0xffffffff;
+		kcp->ssthresh = inflight / 2;
+		if (kcp->ssthresh < IKCP_THRESH_MIN)
+			kcp->ssthresh = IKCP_THRESH_MIN;
+		kcp->cwnd = kcp->ssthresh + resent;
+		kcp->incr = kcp->cwnd * kcp->mss;
+	}
+	else if (kind == IKCP_LOSS_TIMEOUT) {
+		kcp->ssthresh = cwnd / 2;
+		if (kcp->ssthresh < IKCP_THRESH_MIN)
+			kcp->ssthresh = IKCP_THRESH_MIN;
+		kcp->cwnd = 1;
+		kcp->incr = kcp->mss;
+	}
+}
+
+static IUINT32 ikcp_classic_cwnd(const ikcpcb *kcp)
+{
+	return kcp->cwnd;
+}
+
+static IUINT32 ikcp_classic_pacing_rate(const ikcpcb *kcp)
+{
+	return 0;
+}
+
+const struct IKCPCCOPS ikcp_cc_classic = {
+	"classic",
+	ikcp_classic_init,
+	ikcp_classic_release,
+	ikcp_classic_on_ack,
+	ikcp_classic_on_loss,
+	NULL,
+	ikcp_classic_cwnd,
+	ikcp_classic_pacing_rate,
+};
+
+
+//---------------------------------------------------------------------
+// bbr: model the path by its bottleneck bandwidth (windowed max of the
+// delivery rate) and round-trip propagation time (windowed min rtt),
+// pace at the bandwidth and cap inflight at a multiple of their
+// product. random loss does not shrink the model, so throughput holds
+// on lossy links while the queue stays near one bdp.
+//---------------------------------------------------------------------
+#define IKCP_BBR_UNIT			256		// gains are fixed point, 256 = 1.0
+#define IKCP_BBR_BW_ROUNDS		10		// bandwidth max filter, in rounds
+#define IKCP_BBR_RTPROP_MS		10000	// min rtt filter window
+#define IKCP_BBR_PROBE_RTT_MS	200		// time spent at min cwnd in probe_rtt
+#define IKCP_BBR_MIN_CWND		4
+#define IKCP_BBR_INIT_CWND		10
+#define IKCP_BBR_FULL_BW_CNT	3		// rounds without growth to leave startup
+
+enum { IKCP_BBR_STARTUP, IKCP_BBR_DRAIN, IKCP_BBR_PROBE_BW, IKCP_BBR_PROBE_RTT };
+
+static const IUINT32 IKCP_BBR_HIGH_GAIN = 739;		// 2/ln(2)
+static const IUINT32 IKCP_BBR_DRAIN_GAIN = 88;		// 1/high_gain
+static const IUINT32 IKCP_BBR_CWND_GAIN = 512;
+static const IUINT32 ikcp_bbr_pacing_cycle[8] = {
+	320, 192, 256, 256, 256, 256, 256, 256
+};
+
+typedef struct IKCPBBR
+{
+	int mode;
+	IUINT32 bw_round[IKCP_BBR_BW_ROUNDS];	// max delivery rate per round
+	IUINT32 btl_bw;							// bytes/sec
+	IINT32 min_rtt;							// ms, -1 until sampled
+	IUINT32 min_rtt_ts;
+	IUINT32 round_count, next_round_delivered;
+	IUINT32 full_bw;
+	int full_bw_count, filled_pipe;
+	int cycle_index;
+	IUINT32 cycle_ts;
+	IUINT32 probe_rtt_done_ts;
+	int probe_rtt_round_done;
+	IUINT32 prior_cwnd;
+	IUINT32 pacing_gain, cwnd_gain;
+}	IKCPBBR;
+
+// gain * bandwidth-delay product, in segments
+static IUINT32 ikcp_bbr_target(const ikcpcb *kcp, const IKCPBBR *bbr, 
+	IUINT32 gain)
+{
+	IUINT64 bdp;
+	if (bbr->btl_bw == 0 || bbr->min_rtt < 0) 
+		return IKCP_BBR_INIT_CWND;
+	bdp = (IUINT64)bbr->btl_bw * (IUINT32)bbr->min_rtt / 1000;
+	bdp = bdp * gain / IKCP_BBR_UNIT;
+	bdp = (bdp + kcp->mss + IKCP_OVERHEAD - 1) / (kcp->mss + IKCP_OVERHEAD);
+	if (bdp < IKCP_BBR_MIN_CWND) bdp = IKCP_BBR_MIN_CWND;
+	if (bdp > 0x7fffffff) bdp = 0x7fffffff;
+	return (IUINT32)bdp;
+}
+
+static void ikcp_bbr_enter_probe_bw(ikcpcb *kcp, IKCPBBR *bbr)
+{
+	bbr->mode = IKCP_BBR_PROBE_BW;
+	bbr->cwnd_gain = IKCP_BBR_CWND_GAIN;
+	// start anywhere but the draining phase
+	bbr->cycle_index = (int)(kcp->current % 7);
+	if (bbr->cycle_index >= 1) bbr->cycle_index++;
+	bbr->cycle_ts = kcp->current;
+	bbr->pacing_gain = ikcp_bbr_pacing_cycle[bbr->cycle_index];
+}
+
+static void ikcp_bbr_update_model(ikcpcb *kcp, IKCPBBR *bbr, 
+	const struct IKCPACKSAMPLE *sample, int *round_start)
+{
+	int i;
+	*round_start = 0;
+	if (sample->rate > 0) {
+		if (_itimediff(sample->prior_delivered, 
+			bbr->next_round_delivered) >= 0) {
+			bbr->next_round_delivered = sample->delivered;
+			bbr->round_count++;
+			bbr->bw_round[bbr->round_count % IKCP_BBR_BW_ROUNDS] = 0;
+			*round_start = 1;
+		}
+		i = bbr->round_count % IKCP_BBR_BW_ROUNDS;
+		if (sample->rate > bbr->bw_round[i]) 
+			bbr->bw_round[i] = sample->rate;
+		bbr->btl_bw = 0;
+		for (i = 0; i < IKCP_BBR_BW_ROUNDS; i++) {
+			if (bbr->bw_round[i] > bbr->btl_bw) 
+				bbr->btl_bw = bbr->bw_round[i];
+		}
+	}
+	if (sample->rtt >= 0) {
+		if (bbr->min_rtt < 0 || sample->rtt <= bbr->min_rtt) {
+			bbr->min_rtt = sample->rtt;
+			bbr->min_rtt_ts = sample->current;
+		}
+	}
+}
+
+static void ikcp_bbr_update_mode(ikcpcb *kcp, IKCPBBR *bbr, 
+	const struct IKCPACKSAMPLE *sample, int round_start)
+{
+	IUINT32 current = sample->current;
+
+	// startup until the bandwidth stops growing by 25% per round
+	if (round_start && bbr->filled_pipe == 0) {
+		if ((IUINT64)bbr->btl_bw * 4 >= (IUINT64)bbr->full_bw * 5) {
+			bbr->full_bw = bbr->btl_bw;
+			bbr->full_bw_count = 0;
+		}	else if (++bbr->full_bw_count >= IKCP_BBR_FULL_BW_CNT) {
+			bbr->filled_pipe = 1;
+		}
+	}
+	if (bbr->mode == IKCP_BBR_STARTUP && bbr->filled_pipe) {
+		bbr->mode = IKCP_BBR_DRAIN;
+		bbr->pacing_gain = IKCP_BBR_DRAIN_GAIN;
+		bbr->cwnd_gain = IKCP_BBR_HIGH_GAIN;
+	}
+	if (bbr->mode == IKCP_BBR_DRAIN && 
+		sample->inflight <= ikcp_bbr_target(kcp, bbr, IKCP_BBR_UNIT)) {
+		ikcp_bbr_enter_probe_bw(kcp, bbr);
+	}
+
+	// cycle the pacing gain once per min rtt, leave the 0.75 phase
+	// early once the queue is drained
+	if (bbr->mode == IKCP_BBR_PROBE_BW) {
+		int next = 0;
+		if (_itimediff(current, bbr->cycle_ts) > bbr->min_rtt) 
+			next = 1;
+		else if (bbr->pacing_gain < IKCP_BBR_UNIT && 
+			sample->inflight <= ikcp_bbr_target(kcp, bbr, IKCP_BBR_UNIT))
+			next = 1;
+		if (next) {
+			bbr->cycle_index = (bbr->cycle_index + 1) % 8;
+			bbr->cycle_ts = current;
+			bbr->pacing_gain = ikcp_bbr_pacing_cycle[bbr->cycle_index];
+		}
+	}
+
+	// min rtt went stale: drain to a few segments to measure it again
+	if (bbr->mode != IKCP_BBR_PROBE_RTT && bbr->min_rtt >= 0 &&
+		_itimediff(current, bbr->min_rtt_ts) > IKCP_BBR_RTPROP_MS) {
+		bbr->mode = IKCP_BBR_PROBE_RTT;
+		bbr->pacing_gain = IKCP_BBR_UNIT;
+		bbr->prior_cwnd = kcp->cwnd;
+		bbr->probe_rtt_done_ts = 0;
+		bbr->probe_rtt_round_done = 0;
+	}
+	if (bbr->mode == IKCP_BBR_PROBE_RTT) {
+		if (bbr->probe_rtt_done_ts == 0 && 
+			sample->inflight <= IKCP_BBR_MIN_CWND) {
+			bbr->probe_rtt_done_ts = current + IKCP_BBR_PROBE_RTT_MS;
+			if (bbr->probe_rtt_done_ts == 0) bbr->probe_rtt_done_ts = 1;
+			bbr->probe_rtt_round_done = 0;
+			bbr->next_round_delivered = sample->delivered;
+		}	
+		else if (bbr->probe_rtt_done_ts != 0) {
+			if (round_start) bbr->probe_rtt_round_done = 1;
+			if (bbr->probe_rtt_round_done && 
+				_itimediff(current, bbr->probe_rtt_done_ts) >= 0) {
+				bbr->min_rtt_ts = current;
+				if (kcp->cwnd < bbr->prior_cwnd) 
+					kcp->cwnd = bbr->prior_cwnd;
+				if (bbr->filled_pipe) {
+					ikcp_bbr_enter_probe_bw(kcp, bbr);
+				}	else {
+					bbr->mode = IKCP_BBR_STARTUP;
+					bbr->pacing_gain = IKCP_BBR_HIGH_GAIN;
+					bbr->cwnd_gain = IKCP_BBR_HIGH_GAIN;
+				}
+			}
+		}
+	}
+}
+
+static int ikcp_bbr_init(ikcpcb *kcp)
+{
+	IKCPBBR *bbr = (IKCPBBR*)ikcp_malloc(sizeof(IKCPBBR));
+	if (bbr == NULL) return -1;
+	memset(bbr, 0, sizeof(IKCPBBR));
+	bbr->mode = IKCP_BBR_STARTUP;
+	bbr->min_rtt = -1;
+	bbr->min_rtt_ts = kcp->current;
+	bbr->next_round_delivered = kcp->delivered;
+	bbr->pacing_gain = IKCP_BBR_HIGH_GAIN;
+	bbr->cwnd_gain = IKCP_BBR_HIGH_GAIN;
+	kcp->cc_data = bbr;
+	if (kcp->cwnd < IKCP_BBR_INIT_CWND) {
+		kcp->cwnd = IKCP_BBR_INIT_CWND;
+		kcp->incr = kcp->cwnd * kcp->mss;
+	}
+	return 0;
+}
+
+static void ikcp_bbr_release(ikcpcb *kcp)
+{
+	if (kcp->cc_data) {
+		ikcp_free(kcp->cc_data);
+		kcp->cc_data = NULL;
+	}
+}
+
+static void ikcp_bbr_on_ack(ikcpcb *kcp, const struct IKCPACKSAMPLE *sample)
+{
+	IKCPBBR *bbr = (IKCPBBR*)kcp->cc_data;
+	IUINT32 target, cwnd = kcp->cwnd;
+	int round_start;
+
+	ikcp_bbr_update_model(kcp, bbr, sample, &round_start);
+	ikcp_bbr_update_mode(kcp, bbr, sample, round_start);
+
+	// grow by what was acked, never above gain * bdp once the pipe is full
+	target = ikcp_bbr_target(kcp, bbr, bbr->cwnd_gain);
+	if (bbr->filled_pipe) {
+		cwnd = _imin_(cwnd + sample->acked, target);
+	}	else if (cwnd < target || kcp->delivered < 
+		IKCP_BBR_INIT_CWND * (kcp->mss + IKCP_OVERHEAD)) {
+		cwnd += sample->acked;
+	}
+	if (bbr->mode == IKCP_BBR_PROBE_RTT) 
+		cwnd = _imin_(cwnd, IKCP_BBR_MIN_CWND);
+	kcp->cwnd = _imax_(cwnd, IKCP_BBR_MIN_CWND);
+	kcp->incr = kcp->cwnd * kcp->mss;
+}
+
+static void ikcp_bbr_on_loss(ikcpcb *kcp, int kind, IUINT32 cwnd)
+{
+	// random loss says nothing about the bottleneck, only a timeout
+	// (the whole flight gone) makes us restart from a small window
+	if (kind == IKCP_LOSS_TIMEOUT) {
+		IKCPBBR *bbr = (IKCPBBR*)kcp->cc_data;
+		bbr->prior_cwnd = _imax_(bbr->prior_cwnd, kcp->cwnd);
+		kcp->cwnd = IKCP_BBR_MIN_CWND;
+		kcp->incr = kcp->cwnd * kcp->mss;
+	}
+}
+
+static IUINT32 ikcp_bbr_cwnd(const ikcpcb *kcp)
+{
+	return kcp->cwnd;
+}
+
+static IUINT32 ikcp_bbr_pacing_rate(const ikcpcb *kcp)
+{
+	const IKCPBBR *bbr = (const IKCPBBR*)kcp->cc_data;
+	IUINT64 rate;
+	if (bbr->btl_bw == 0) {
+		if (kcp->rx_srtt <= 0) return 0;
+		rate = (IUINT64)kcp->cwnd * (kcp->mss + IKCP_OVERHEAD) * 1000 / 
+			(IUINT32)kcp->rx_srtt;
+	}	else {
+		rate = bbr->btl_bw;
+	}
+	rate = rate * bbr->pacing_gain / IKCP_BBR_UNIT;
+	if (rate > 0xffffffff) rate = 0xffffffff;
+	return (rate > 0)? (IUINT32)rate : 1;
+}
+
+const struct IKCPCCOPS ikcp_cc_bbr = {
+	"bbr",
+	ikcp_bbr_init,
+	ikcp_bbr_release,
+	ikcp_bbr_on_ack,
+	ikcp_bbr_on_loss,
+	NULL,
+	ikcp_bbr_cwnd,
+	ikcp_bbr_pacing_rate,
+};
+
+
+//---------------------------------------------------------------------
+// congestion control interface
+//---------------------------------------------------------------------
+const struct IKCPCCOPS* ikcp_cc_find(const char *name)
+{
+	if (name == NULL) return NULL;
+	if (strcmp(name, ikcp_cc_classic.name) == 0) return &ikcp_cc_classic;
+	if (strcmp(name, ikcp_cc_bbr.name) == 0) return &ikcp_cc_bbr;
+	return NULL;
+}
+
+int ikcp_setcc(ikcpcb *kcp, const struct IKCPCCOPS *ops)
+{
+	assert(kcp);
+	if (ops == NULL) return -1;
+	if (kcp->cc && kcp->cc->release) {
+		kcp->cc->release(kcp);
+	}
+	kcp->cc = ops;
+	kcp->cc_data = NULL;
+	if (ops->init && ops->init(kcp) < 0) {
+		kcp->cc = &ikcp_cc_classic;
+		kcp->cc_data = NULL;
+		return -2;
+	}
+	return 0;
+}
+
+IUINT32 ikcp_pacing_rate(const ikcpcb *kcp)
+{
+	IUINT32 rate = kcp->cc->pacing_rate(kcp);
+	IUINT32 cwnd;
+	IUINT64 derived;
+	if (rate > 0 || kcp->rx_srtt <= 0) 
+		return rate;
+	// controller has no opinion: spread the window over one srtt, with
+	// 25% headroom so pacing alone never becomes the bottleneck
+	cwnd = _imin_(kcp->snd_wnd, kcp->rmt_wnd);
+	if (kcp->nocwnd == 0) cwnd = _imin_(kcp->cc->cwnd(kcp), cwnd);
+	if (cwnd < 1) cwnd = 1;
+	derived = (IUINT64)cwnd * (kcp->mss + IKCP_OVERHEAD) * 1000 / 
+		(IUINT32)kcp->rx_srtt;
+	derived += derived / 4;
+	return (derived > 0xffffffff)? 0xffffffff : (IUINT32)derived;
+}
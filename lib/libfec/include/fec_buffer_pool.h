@@ -0,0 +1,40 @@
+//
+// Created by lwj on 2020/3/21.
+//
+
+#ifndef LIBFEC_FEC_BUFFER_POOL_H
+#define LIBFEC_FEC_BUFFER_POOL_H
+
+#include <cstdint>
+#include <vector>
+#include "noncopyable.h"
+
+/**
+ * fixed size buffers recycled through a free list, a FecDecode keeps the shards it holds
+ * in them and its caller receives datagrams straight into them, so decoding allocates
+ * nothing once the pool has grown to the number of buffers in flight
+ * @note not thread safe, FecDecode only touches it under its own lock
+ */
+class FecBufferPool : noncopyable {
+ public:
+  ///buffer_size bytes can be received into a buffer, kFecBufferSlack more bytes behind
+  ///them are left for the zero padding of fec decoding
+  explicit FecBufferPool(const int32_t& buffer_size);
+  ///a free buffer, the pool only grows when none is left
+  char* Acquire();
+  ///buffer must come from Acquire of this pool
+  void Release(char* buffer);
+  int32_t buffer_size() const { return buffer_size_; }
+ private:
+  void Grow();
+ private:
+  static const int32_t kFecBufferSlack = 64;
+  static const int32_t kFecBuffersPerChunk = 64;
+  const int32_t buffer_size_;
+  ///distance between two buffers of a chunk, keeps every buffer 64 bytes aligned
+  const int32_t stride_;
+  std::vector<std::vector<char>> chunks_;
+  std::vector<char *> free_;
+};
+
+#endif //LIBFEC_FEC_BUFFER_POOL_H
@@ -10,36 +10,129 @@
 #include <cstring>
 #include <atomic>
 #include <mutex>
-#include <map>
 #include <memory>
-#include "timeout_map.h"
-
-typedef struct{
-  std::atomic_bool ready_for_output;
-  char *data = nullptr;
-  uint32_t actural_len;
-  uint32_t max_len;
-  uint32_t last_process_seq;
-  uint32_t last_process_index;
-  int32_t LargerMem(uint32_t expected_len);
-} FecDecodeOutputDataUnit;
-
-class FecDecode {
+#include <functional>
+#include <bitset>
+#include "timing_wheel.h"
+#include "fec_header.h"
+#include "fec_window_decode.h"
+#include "fec_buffer_pool.h"
+#include "fec_lock.h"
+
+///default size of the receive buffers of FecDecode, the longest datagram it takes
+const int32_t kFecDecodeBufferSize = 4096;
+
+///groups larger than this are rejected by FecDecode, the fec header counts shards in 8 bits
+const int32_t kFecDecodeMaxShards = 255;
+///bit i stands for shard i(0 based)
+typedef std::bitset<kFecDecodeMaxShards> FecShardBitmap;
+///number of groups tracked at once, divides kFecSeqMax so that seq % window
+///stays continuous when the seq wraps
+const int32_t kFecDecodeWindow = 240;
+///a group is counted for loss feedback once this many newer groups have been seen,
+///so reordered shards still make it in
+const int32_t kFecSettleDistance = 16;
+///minimal interval between two loss feedback packets
+const uint64_t kFecFeedbackIntervalMs = 1000;
+
+enum FecDecodeGroupState : uint8_t {
+  kFecGroupFree = 0,
+  ///collecting shards
+  kFecGroupFilling,
+  ///every data shard has arrived or been rebuilt, some still wait for Output
+  kFecGroupReady,
+  ///given up on, it timed out or failed to decode, only the data shards still queued
+  ///for Output are kept until they are copied out
+  kFecGroupDraining,
+  ///all data shards have been output, or the group timed out or failed to decode,
+  ///kept so late shards are ignored
+  kFecGroupDone,
+};
+
+///one slot of the decode ring, everything about a group lives inline here, a value
+///initialized one is free
+typedef struct {
+  uint16_t seq;
+  uint8_t state;
+  uint8_t flags;
+  uint8_t data_pkg_num;
+  uint8_t redundant_pkg_num;
+  uint8_t recv_num;
+  int32_t max_length;
+  ///shards[i] points head_length bytes into a buffer of the decoder's pool, behind the fec header
+  uint8_t head_length;
+  ///bit i set means shard i(0 based) has been received
+  FecShardBitmap recv_bitmap;
+  ///bit i set means data shard i has been queued for Output, arrived or rebuilt
+  FecShardBitmap output_bitmap;
+  ///bit i set means data shard i is queued for Output but not yet copied out
+  FecShardBitmap pending_bitmap;
+  ///every unique shard seen, kept after the group is done for the loss feedback
+  FecShardBitmap seen_bitmap;
+  char *shards[kFecDecodeMaxShards];
+  uint16_t lengths[kFecDecodeMaxShards];
+  ///fires timeout_ms after the last shard of a filling group, data is the slot index
+  TimingWheelTimer timer;
+} FecDecodeGroup;
+
+///a data shard waiting for Output, looked up in the ring by seq
+typedef struct {
+  uint16_t seq;
+  uint8_t index;
+} FecDecodeOutputEntry;
+
+const int32_t kFecDecodeOutputQueueSize = 4 * kFecDecodeWindow;
+
+///an unencoded package waiting for Output, kept in the pool buffer it arrived in
+typedef struct {
+  char *buffer;
+  ///of the data behind the 4 bytes magic
+  int32_t length;
+} FecDecodeRawEntry;
+
+const int32_t kFecDecodeRawQueueSize = 64;
+
+/**
+ * @tparam Lock std::mutex when Input and Output run on different threads, NullLock when
+ * one event loop drives the decoder, which then takes no lock and touches no atomic,
+ * see the FecDecode and SingleThreadFecDecode typedefs
+ */
+template<typename Lock>
+class FecDecodeT {
  public:
-  explicit FecDecode(const int32_t &timeout_ms);
-  ~FecDecode();
+  ///buffer_size is the longest datagram Input takes, the size of the pool buffers
+  explicit FecDecodeT(const int32_t &timeout_ms, const int32_t &buffer_size = kFecDecodeBufferSize);
+  ~FecDecodeT();
   /**
    * @param input_data_pkg 指向输入数据的指针
    * @param length 输入数据的长度
    * @return 如果返回值大于等于0,说明正常返回,返回值为0代表正常接收,返回值为1代表可以进行fec解码,
    * 调用Output函数可以获得解码之后的数据,如果小于0代表发生错误,一般因为输入数据包内容有问题
+   * data shards are handed to Output as soon as they arrive, parity is only used to
+   * rebuild the data shards that are still missing once the group has k shards
    * return 0 means data package has been correctly received but not prepared
    * for output, return positive number means the length of the prepared data
    * package, you should call @func Output with a buffer of length @return
-   * return -2 means input_data_pkg is a wrong data package
+   * return -2 means input_data_pkg is a wrong data package, -1 is returned for a
+   * shard whose crc(kFecFlagCrc) does not match, it is dropped as if it were lost
+   * packets of the sliding window code(FecWindowEncode) are decoded by an inner
+   * FecWindowDecode, their source packets come out of the same Output
    */
   int32_t Input(const char *input_data_pkg, int32_t length);
 
+  /**
+   * same as @func Input, but the datagram has been received into buffer, which came from
+   * @func AcquireBuffer, a shard or unencoded package the decoder keeps stays where it is
+   * and buffer is swapped for a fresh one, so the caller's receive ring never runs dry
+   * and nothing is copied
+   */
+  int32_t InputBuffer(char *&buffer, int32_t length);
+
+  ///a receive buffer of BufferSize() bytes for @func InputBuffer
+  char *AcquireBuffer();
+  void ReleaseBuffer(char *buffer);
+  int32_t BufferSize() const;
+
   /**
    * handle the issue when fec_encode send some unencoded data
    * @param input_data_pkg pointer to the start position of the data package
@@ -61,30 +154,111 @@ class FecDecode {
    */
   int32_t Output(char *recv_buf, int32_t length);
 
+  /**
+   * takes the next prepared data package without copying it
+   * @param data points to the package, it stays valid until @func ReleaseViews, the
+   * buffers of the groups output meanwhile are only recycled then
+   * @return the length of the package, 0 when nothing is prepared
+   */
+  int32_t OutputView(const char *&data);
+  /**
+   * hands every prepared data package to handler in the order Output would copy them,
+   * in one pass under one lock, handler must not call back into the decoder
+   * @note the views stay valid until @func ReleaseViews, same as those of OutputView
+   * @return the number of packages handed out
+   */
+  int32_t Drain(const std::function<void(const char *data, int32_t length)> &handler);
+  ///every view handed out by OutputView or Drain becomes invalid
+  void ReleaseViews();
+
   /**
    * 清除过期的数据,如果一些数据长时间没有获得足够的包来进行fec解码,就变成无用的数据了,可以调用
    * 这个函数来清除这些无用的数据
+   * the event loop calls it with its clock on every tick, every group that timed out
+   * since is released right away, without the clock it reads the time itself
    */
+  void ClearTimeoutDatas(const uint64_t &cur_millsec);
   void ClearTimeoutDatas();
+
+  /**
+   * writes a loss report of the groups settled, and of the sliding window source packets
+   * seen, since the last report, at most once
+   * every kFecFeedbackIntervalMs, the caller sends it to the peer's FecDecode::Input
+   * @return the feedback length, 0 when there is nothing to report yet
+   */
+  int32_t Feedback(char *buf, const int32_t &length, const uint64_t &cur_millsec);
+  ///called with every loss report the peer sends back, e.g. FecEncode::OnFeedback
+  void SetFeedbackHandler(std::function<void(const FecFeedback &)> handler);
  private:
-  void RemoveSeqRespondData(const uint32_t& seq);
-  int32_t SearchForNextReadySeq(const int32_t& least_len);
- private:
-  std::mutex seq_mutex_;///这个锁的范围比较大,保护下面6个数据结构
-  std::map<uint32_t, int32_t> seq2data_pkgs_num_;
-  std::map<uint32_t, int32_t> seq2redundant_data_pkgs_num_;
-  std::map<uint32_t, int32_t> seq2max_data_pkg_length_;
-  std::shared_ptr<TimeOutMap> Sptr2TimeoutMap_;
-  std::map<uint32_t, std::vector<char *>> seq2data_pkgs_;
-  std::map<uint32_t, std::vector<int32_t>> seq2data_pkgs_length_;
-  std::map<uint32_t , int32_t > seq2cur_recv_data_pkg_num_;
-  std::map<uint32_t , bool> seq2ready_for_output_;
-  std::atomic_int ready_seqs_nums_;
+  ///the slot of seq, evicting an older group found there, nullptr if seq itself is too old
+  FecDecodeGroup *AcquireGroup(const uint16_t &seq);
+  ///a group closed early by the encoder's deadline has parity over k' < k data shards,
+  ///shrinks the group to k' when the shard header disagrees with it, -1 if it can not be
+  int32_t ReshapeGroup(FecDecodeGroup &group, const FecHeader &header, const int32_t &index);
+  int32_t DecodeGroup(FecDecodeGroup &group);
+  void ReleaseGroup(FecDecodeGroup &group);
+  ///gives up on a group that timed out or failed to decode, frees what is not queued
+  ///for Output and leaves it draining, or done if nothing is queued
+  void AbandonGroup(FecDecodeGroup &group);
+  void QueueOutput(FecDecodeGroup &group, const int32_t &index);
+  void PopOutput();
+  ///length of the data package the next Output copies, 0 if none
+  int32_t NextOutputLength();
+  ///length of what the next Output copies, unencoded packages go first, then sliding window ones
+  int32_t PendingLength();
+  int32_t InputPkg(const char *input_data_pkg, int32_t length, char **buffer);
+  ///buffer nullptr copies the package into a pool buffer, otherwise *buffer is kept
+  int32_t DealUnEncodeDataLocked(const char *input_data_pkg, int32_t length, char **buffer);
+  void PopRaw();
+  ///OutputView without the lock
+  int32_t NextView(const char *&data);
+  ///hands a buffer back to the pool, or holds it while views are out
+  void Recycle(char *buffer);
+  ///ready_seqs_nums_ = everything queued for Output but the sliding window packets
+  void UpdateReadyNum();
+  void ClearTimeoutDatasLocked(const uint64_t &cur_millsec);
+  ///counts the shards of every group kFecSettleDistance older than newest
+  void SettleGroups(const uint16_t &newest, const int32_t &shard_num);
+  ///counts a sliding window source packet, the esis skipped before it as lost
+  void CountWindowSource(const uint16_t &esi);
  private:
-  std::mutex output_unit_mutex_;
-  FecDecodeOutputDataUnit output_unit_;
-  const int32_t fec_encode_head_length_ = 11;
-  const uint32_t unique_header_ = 0x12345678;
+  Lock seq_mutex_;///这个锁的范围比较大,保护下面的数据结构
+  std::vector<FecDecodeGroup> groups_;
+  ///data shards in the order they arrived or were rebuilt
+  std::vector<FecDecodeOutputEntry> output_queue_;
+  int32_t output_head_;
+  int32_t output_count_;
+  const int32_t timeout_ms_;
+  ///expiry of the filling groups, moved by ClearTimeoutDatas
+  TimingWheel timeout_wheel_;
+  typename FecLockTraits<Lock>::template Atomic<int32_t> ready_seqs_nums_;
+  ///loss measurement, groups up to settled_seq_ have been counted
+  bool loss_started_;
+  uint16_t settled_seq_;
+  uint32_t loss_received_;
+  uint32_t loss_expected_;
+  uint64_t last_feedback_ms_;
+  bool window_loss_started_;
+  ///newest sliding window source packet counted
+  uint16_t window_loss_esi_;
+  std::function<void(const FecFeedback &)> feedback_handler_;
+  FecWindowDecode window_decoder_;
+  ///length of the next sliding window packet for Output, read without the lock
+  typename FecLockTraits<Lock>::template Atomic<int32_t> window_ready_length_;
+  std::vector<FecDecodeRawEntry> raw_queue_;
+  int32_t raw_head_;
+  int32_t raw_count_;
+  FecBufferPool pool_;
+  ///buffers released while views are out, back to the pool on ReleaseViews
+  std::vector<char *> held_buffers_;
+  bool views_out_;
+  ///work area of fec16_decode
+  std::vector<char> fec16_work_;
+  const uint32_t unique_header_ = kFecHeaderMagic;
 };
 
+///instantiated in fec_decode.cpp for these two only
+typedef FecDecodeT<std::mutex> FecDecode;
+typedef FecDecodeT<NullLock> SingleThreadFecDecode;
+
 #endif //LIBFEC_FEC_DECODE_H
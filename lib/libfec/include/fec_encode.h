@@ -9,16 +9,84 @@
 #include <atomic>
 #include <cstdint>
 #include <vector>
+#include <utility>
 #include <mutex>
 #include "rs.h"
+#include "fec_header.h"
+#include "fec_lock.h"
 
-class FecEncode{
+///a group being filled, its k+m slots are data_pkgs[first_slot, first_slot + k + m) of its bucket
+typedef struct {
+  uint16_t seq;
+  int32_t first_slot;
+  int32_t cur_data_pkgs_num;
+  int32_t max_data_pkg_length;
+} FecEncodeGroup;
+
+///interleaving never goes deeper than this, FecDecode settles a group for its loss
+///feedback only kFecSettleDistance groups later
+const int32_t kFecMaxInterleave = 8;
+
+///packages up to max_length bytes are grouped only with each other, an open round of
+///them is flushed deadline_ms after its first package
+typedef struct {
+  int32_t max_length;
+  uint32_t deadline_ms;
+} FecSizeClass;
+
+const int32_t kFecMaxSizeClasses = 4;
+
+///the open groups of one size class, every class has its own shape, rounds and arena
+///so that tiny control packets never pad the parity of full sized data
+struct FecEncodeBucket {
+  FecSizeClass size_class;
+  int32_t data_pkg_num;
+  int32_t redundant_pkg_num;
+  ///fec header flags of every group, decides the header length
+  uint8_t flags;
+  int32_t head_length;
+  int32_t interleave;
+  ///packages input in the current round, a round fills every interleaved group once
+  int32_t round_pkgs_num;
+  ///the round is complete, its slots are reused once Output has been called
+  bool round_complete;
+  int64_t round_start_ms;
+  ///how long one package takes to arrive, measured over the last round, -1 means unknown
+  double pkg_interval_ms;
+  ///interleave * (k+m) slots of slot_size bytes reused by every round, a shard's payload
+  ///starts kFecSlotHeadroom bytes into its slot with the fec header written just before it
+  std::vector<char> arena;
+  int32_t slot_size;
+  ///where each shard's fec header starts
+  std::vector<char *> data_pkgs;
+  std::vector<int32_t> data_pkgs_length;
+  std::vector<FecEncodeGroup> groups;
+};
+
+/**
+ * @tparam Lock std::mutex when Input/Output and the timer run on different threads,
+ * NullLock when one event loop drives the encoder, which then takes no lock and
+ * touches no atomic, see the FecEncode and SingleThreadFecEncode typedefs
+ */
+template<typename Lock>
+class FecEncodeT {
  public:
-  FecEncode(const int32_t& data_pkg_num, const int32_t& redundant_pkg_num, const uint32_t& timeout = 1);
-  ~FecEncode();
+  ///with xor_parity a single redundant shard is the xor of the data shards instead of
+  ///a reed-solomon parity, groups are flagged in the extended fec header, which peers
+  ///built before it cannot parse, so it is off by default
+  ///with adaptive the group shape is retuned from the peer's loss feedback, see @func OnFeedback,
+  ///(data_pkg_num, redundant_pkg_num) is only the shape used until the first report
+  ///every package shares one size class with a deadline of timeout seconds until
+  ///@func SetSizeClasses says otherwise
+  FecEncodeT(const int32_t& data_pkg_num, const int32_t& redundant_pkg_num, const uint32_t& timeout = 1,
+             const bool& xor_parity = false, const bool& adaptive = false);
+  ~FecEncodeT();
   ///return 1 means that fec encode is ok, and user need to call Output to get encoded data.
+  ///every data shard can be sent as soon as it is input, the parity shards are added
+  ///to the output of the input that completes the group
   int32_t Input(const char* input_data_pkg, int32_t length);
   ///调用者必须手动从出参中复制数据,并不能直接使用返回的指针
+  ///the pointers point into the shard arena and stay valid until the next round of groups starts
   int32_t Output(std::vector<char*>& data_pkgs, std::vector<int32_t>& data_pkgs_length);
   /**
    * this function is used to update inside timer of FecEncode
@@ -26,31 +94,103 @@ class FecEncode{
    * call this function in a fixed interval
    * @param cur_millsec the current milliseconds
    * @return return 0 for everything is fine, return -1 for error, and return a positive
-   * number means @func Input data package timeout, need to be flushed, and you should
-   * call @func FlushUnEncodedData next
+   * number, the size classes whose open round is past its deadline, which need to be
+   * flushed, and you should call @func FlushUnEncodedData next
    */
   int32_t FecEncodeUpdateTime(const uint64_t& cur_millsec);
-  ///output the unencoded data, note that you should copy the data from the pointers
-  ///that this function return, and the pointers will be freed next time you call @Input
+  ///milliseconds, on the clock of getnowtime_ms, at which the earliest open round reaches
+  ///its deadline, -1 if no round is open, lets the caller arm a timer instead of polling
+  int64_t NextDeadline();
+  ///closes the groups of the size classes found past their deadline by the last
+  ///FecEncodeUpdateTime, or of every class if none was, a group with k' < k data shards
+  ///gets its parity over those k', the parity headers carry k' as data_pkg_num,
+  ///returns the parity together with any shards not fetched by Output yet
   int32_t FlushUnEncodedData(std::vector<char*>& data_pkgs, std::vector<int32_t>& data_pkg_length);
+  /**
+   * splits packages into size classes by length, each grouped apart from the others,
+   * lengths above the largest max_length fall into a class with the constructor's timeout
+   * @note at most kFecMaxSizeClasses classes, call it before the first Input
+   */
+  void SetSizeClasses(std::vector<FecSizeClass> size_classes);
+  /**
+   * loss report of the peer's decoder, picks the cheapest (k, m) that keeps the residual
+   * loss low, more redundancy is taken at once, less only after several calm reports
+   * @note the new shape starts with the next round of groups
+   */
+  void OnFeedback(const FecFeedback& feedback);
+  /**
+   * spreads consecutive packages round-robin over up to depth concurrent groups, so a
+   * burst of loss hits several groups a little instead of one group badly
+   * @param latency_budget_ms interleaving delays parity, the depth is cut down so that a
+   * group is still complete within this budget at the measured package rate
+   * @note takes effect with the next round of groups
+   */
+  void SetInterleave(const int32_t& depth, const uint32_t& latency_budget_ms);
+  /**
+   * groups with more than one parity shard are encoded with the FFT based code over
+   * GF(2^16) of fec16.h instead of the vandermonde one, flagged in the fec header, its
+   * cost grows O(n log n) with the group, which pays off for groups such as 200 + 40
+   * @note takes effect with the next round of groups, the peer's FecDecode has to know the flag
+   */
+  void SetGf16(const bool& gf16);
+  /**
+   * every shard carries a crc32c in its fec header, so the peer's FecDecode drops a
+   * corrupted shard and rebuilds it from parity instead of passing garbage on to kcp
+   * @note takes effect with the next round of groups, costs 4 bytes per shard
+   */
+  void SetCrc(const bool& crc);
  private:
-  void ResetDataPkgs();
+  ///makes every slot of the bucket at least slot_size bytes, keeps the shards already written
+  void GrowArena(FecEncodeBucket& bucket, int32_t slot_size);
+  void NextSeq();
+  ///switches a bucket to a (k, m) group shape and interleave depth, only between two rounds
+  void ApplyShape(FecEncodeBucket& bucket, const int32_t& data_pkg_num, const int32_t& redundant_pkg_num,
+                  const int32_t& interleave);
+  ///picks shape and depth for the round of the bucket that starts now
+  void StartRound(FecEncodeBucket& bucket);
+  ///fec header flags of a group with redundant_pkg_num parity shards
+  uint8_t FlagsOf(const int32_t& redundant_pkg_num) const;
+  void EncodeGroup(FecEncodeBucket& bucket, FecEncodeGroup& group);
+  ///hands out the pending shards, rounds that are complete start over
+  void TakePending(std::vector<char*>& data_pkgs, std::vector<int32_t>& data_pkgs_length);
  private:
-  std::atomic_uint_least64_t inside_timer_;
-  std::atomic_uint_least64_t newest_update_time_;
-  std::atomic_int cur_data_pkgs_num_;
-  std::atomic_int max_data_pkg_length_;
-  std::vector<char *> data_pkgs_;
-  std::vector<int32_t > data_pkgs_length_;
-  std::mutex data_pkgs_mutex_;
-  std::atomic_bool ready_for_fec_output_;
+  typename FecLockTraits<Lock>::template Atomic<uint_least64_t> inside_timer_;
+  ///at most kFecMaxSizeClasses buckets ordered by max_length, the last one takes any length
+  std::vector<FecEncodeBucket> buckets_;
+  ///payload pointers handed to the encoders
+  std::vector<char *> shards_;
+  Lock data_pkgs_mutex_;
+  ///(bucket, slot) of the shards waiting for Output
+  std::vector<std::pair<int32_t, int32_t> > pending_slots_;
+  ///bit i set means bucket i was found past its deadline by FecEncodeUpdateTime
+  uint32_t expired_buckets_;
+  ///the shape of the constructor, used until the first feedback
   int32_t data_pkg_num_;
   int32_t redundant_pkg_num_;
+  int32_t max_interleave_;
+  uint32_t latency_budget_ms_;
   uint16_t seq;
+  const bool xor_parity_;
+  const bool adaptive_;
+  bool gf16_;
+  bool crc_;
+  ///work area of fec16_encode
+  std::vector<char> fec16_work_;
+  ///smoothed shard loss reported by the peer
+  double loss_;
+  bool loss_valid_;
+  ///current step of the shape ladder, -1 until the first feedback
+  int32_t shape_rung_;
+  ///reports in a row that allowed a cheaper shape
+  int32_t calm_rounds_;
  private:
-  const int32_t fec_encode_head_length_ = 11;
-  const uint32_t unique_header_ = 0x12345678;
+  static const int32_t kFecSlotHeadroom = 16;
+  static const int32_t kFecInitialSlotSize = 2048;
   const uint32_t timeout_time_ = 1;
 };
 
+///instantiated in fec_encode.cpp for these two only
+typedef FecEncodeT<std::mutex> FecEncode;
+typedef FecEncodeT<NullLock> SingleThreadFecEncode;
+
 #endif //LIBFEC_FEC_ENCODE_H
@@ -0,0 +1,114 @@
+//
+// Created by lwj on 2020/3/6.
+//
+
+#ifndef LIBFEC_FEC_HEADER_H
+#define LIBFEC_FEC_HEADER_H
+
+#include <cstdint>
+
+///header in front of every fec shard, big endian:
+///magic(4) seq(2) length(2) data_pkg_num(1) redundant_pkg_num(1) index(1) [flags(1)] [crc(4)]
+///the flags byte only exists behind the extended magic, so a group without
+///flags keeps the original 11 bytes header and old peers can still decode it,
+///the crc only with kFecFlagCrc
+const uint32_t kFecHeaderMagic = 0x12345678;
+const uint32_t kFecHeaderMagicExt = 0x12345679;
+const int32_t kFecHeaderLength = 11;
+const int32_t kFecHeaderExtLength = 12;
+const int32_t kFecHeaderCrcLength = 16;
+
+///group seqs run from 1 to kFecSeqMax and then wrap to 1 again
+const uint16_t kFecSeqMax = 65520;
+
+///the only parity shard is the plain xor of the data shards
+const uint8_t kFecFlagXor = 0x01;
+///the parity comes from the FFT based code over GF(2^16) of fec16.h instead of the
+///vandermonde one, shards are encoded as if zero padded to an even length
+const uint8_t kFecFlagGf16 = 0x02;
+///the header ends with a crc32c of the header before it and of the payload, a shard
+///that does not match is dropped like a lost one and left to fec
+const uint8_t kFecFlagCrc = 0x04;
+
+typedef struct {
+  uint16_t seq;
+  ///length of the data carried by this shard, parity shards carry the group max length
+  uint16_t length;
+  uint8_t data_pkg_num;
+  uint8_t redundant_pkg_num;
+  ///starts from 1
+  uint8_t index;
+  uint8_t flags;
+} FecHeader;
+
+///header length of a shard carrying flags
+int32_t FecHeaderLength(const uint8_t &flags);
+
+///@return the header length written to p
+int32_t WriteFecHeader(char *p, const FecHeader &header);
+
+/**
+ * @return the header length on success, 0 means pkg does not start with an fec
+ * header magic(e.g. unencoded data), -1 means a truncated or invalid header
+ */
+int32_t ParseFecHeader(const char *pkg, const int32_t &length, FecHeader &header);
+
+///fills in the crc of a shard with kFecFlagCrc once its payload is final, length is
+///the whole shard, header included
+void SealFecHeader(char *pkg, const int32_t &length);
+
+///@return false if the shard has kFecFlagCrc and its crc does not match, pkg has
+///been parsed by ParseFecHeader already
+bool VerifyFecHeader(const char *pkg, const int32_t &length);
+
+///loss report a decoder sends back to the encoder of its peer, big endian:
+///magic(4) received_shards(4) expected_shards(4)
+const uint32_t kFecFeedbackMagic = 0x1234567A;
+const int32_t kFecFeedbackLength = 12;
+
+typedef struct {
+  ///unique shards received of the groups settled since the last report
+  uint32_t received;
+  ///shards those groups were made of
+  uint32_t expected;
+} FecFeedback;
+
+///@return the feedback length written to p
+int32_t WriteFecFeedback(char *p, const FecFeedback &feedback);
+
+/**
+ * @return kFecFeedbackLength on success, 0 means pkg is not a feedback packet,
+ * -1 means a truncated feedback packet
+ */
+int32_t ParseFecFeedback(const char *pkg, const int32_t &length, FecFeedback &feedback);
+
+///header of the sliding window code, big endian:
+///magic(4) esi(2) window(1) seed(1) length(2)
+///window 0 marks a source packet with length bytes of data behind the header, any other
+///window a repair packet over the window source packets ending at esi, its payload is
+///length bytes long and seed picks its coefficients, see FecWindowCoef
+const uint32_t kFecWindowMagic = 0x1234567B;
+const int32_t kFecWindowHeaderLength = 10;
+
+typedef struct {
+  ///encoding symbol id, the source packet number, wraps at 65536
+  uint16_t esi;
+  uint8_t window;
+  uint8_t seed;
+  uint16_t length;
+} FecWindowHeader;
+
+///@return the header length written to p
+int32_t WriteFecWindowHeader(char *p, const FecWindowHeader &header);
+
+/**
+ * @return kFecWindowHeaderLength on success, 0 means pkg is not a sliding window
+ * packet, -1 means a truncated or invalid header
+ */
+int32_t ParseFecWindowHeader(const char *pkg, const int32_t &length, FecWindowHeader &header);
+
+///coefficient of the i-th(0 based, oldest first) source packet in the repair packet
+///(esi, seed) of a sliding window code, never 0
+uint8_t FecWindowCoef(const uint16_t &esi, const uint8_t &seed, const int32_t &i);
+
+#endif //LIBFEC_FEC_HEADER_H
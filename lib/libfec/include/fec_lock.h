@@ -0,0 +1,31 @@
+//
+// Created by lwj on 2020/3/23.
+//
+
+#ifndef LIBFEC_FEC_LOCK_H
+#define LIBFEC_FEC_LOCK_H
+
+#include <atomic>
+#include <mutex>
+
+///lock policy of FecEncodeT/FecDecodeT for an encoder or decoder driven by a single
+///thread, locking it costs nothing and its counters are plain integers
+struct NullLock {
+  void lock() {}
+  void unlock() {}
+};
+
+///what the counters read outside the lock are made of under a lock policy
+template<typename Lock>
+struct FecLockTraits {
+  template<typename T>
+  using Atomic = std::atomic<T>;
+};
+
+template<>
+struct FecLockTraits<NullLock> {
+  template<typename T>
+  using Atomic = T;
+};
+
+#endif //LIBFEC_FEC_LOCK_H
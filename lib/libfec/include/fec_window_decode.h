@@ -0,0 +1,79 @@
+//
+// Created by lwj on 2020/3/20.
+//
+
+#ifndef LIBFEC_FEC_WINDOW_DECODE_H
+#define LIBFEC_FEC_WINDOW_DECODE_H
+
+#include <cstdint>
+#include <vector>
+#include "fec_header.h"
+#include "fec_window_encode.h"
+
+///source packets tracked by the decoder, a power of two so esi % span stays continuous
+///when the esi wraps
+const int32_t kFecWindowSpan = 128;
+///a missing source packet older than this many esis is given up
+const int32_t kFecWindowKeep = kFecWindowSpan - kFecWindowMaxSize;
+
+typedef struct {
+  uint16_t esi;
+  bool present;
+  ///the 2 bytes length of the data followed by the data
+  std::vector<char> symbol;
+} FecWindowSource;
+
+///a repair equation still involving missing source packets, kept in reduced row echelon
+///form, coef is indexed by esi % kFecWindowSpan and coef of pivot is 1
+typedef struct {
+  bool used;
+  uint16_t pivot;
+  uint8_t coef[kFecWindowSpan];
+  std::vector<char> payload;
+} FecWindowRow;
+
+/**
+ * decoder of FecWindowEncode, source packets are output as they arrive, every repair
+ * packet is reduced by the source packets already known and kept as an equation until
+ * enough equations rebuild the missing ones, so recovery waits at most for the repair
+ * packets of the next window instead of a group completion
+ * @note not thread safe, FecDecode::Input dispatches to it under its own lock
+ */
+class FecWindowDecode {
+ public:
+  FecWindowDecode();
+  ///same return value as FecDecode::Input
+  int32_t Input(const char *input_data_pkg, int32_t length);
+  ///same return value as FecDecode::Output
+  int32_t Output(char *recv_buf, int32_t length);
+  ///length of the data package the next Output copies, 0 if none
+  int32_t NextOutputLength();
+ private:
+  ///forgets the source packets and equations that fell out of the window ending at esi
+  void Advance(const uint16_t &esi);
+  bool InRange(const uint16_t &esi) const;
+  void AddSource(const uint16_t &esi, const char *data, const int32_t &data_length);
+  ///substitutes a newly known source packet into every equation
+  void Substitute(const uint16_t &esi);
+  void InsertRow(FecWindowRow &row);
+  ///rows left with their pivot only are rebuilt source packets
+  void SolveRows();
+  void QueueOutput(const uint16_t &esi);
+  ///row ^= c * other, coefficients and payload
+  static void AddRow(FecWindowRow &row, const FecWindowRow &other, uint8_t c);
+ private:
+  bool started_;
+  ///newest esi seen, the window is [newest_ - kFecWindowKeep + 1, newest_]
+  uint16_t newest_;
+  std::vector<FecWindowSource> sources_;
+  ///the row of pivot esi at esi % kFecWindowSpan
+  std::vector<FecWindowRow> rows_;
+  ///esis of the source packets waiting for Output
+  std::vector<uint16_t> output_queue_;
+  int32_t output_head_;
+  int32_t output_count_;
+  ///the equation being reduced, swapped with the unused row it ends up replacing
+  FecWindowRow scratch_;
+};
+
+#endif //LIBFEC_FEC_WINDOW_DECODE_H
@@ -0,0 +1,91 @@
+//
+// Created by lwj on 2020/3/20.
+//
+
+#ifndef LIBFEC_FEC_WINDOW_ENCODE_H
+#define LIBFEC_FEC_WINDOW_ENCODE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include "fec_header.h"
+#include "fec_lock.h"
+
+///a repair packet never covers more source packets than this
+const int32_t kFecWindowMaxSize = 32;
+
+/**
+ * sliding window random linear code over GF(2^8), every source packet goes out at once
+ * and after every interval of them come repair packets, each a random combination of
+ * the last window source packets, so a loss is repaired by the next repair packets
+ * instead of waiting for a whole group
+ * @note same Input/Output/FlushUnEncodedData contract as FecEncode
+ * @tparam Lock same lock policy as FecEncodeT, see the FecWindowEncode and
+ * SingleThreadFecWindowEncode typedefs
+ */
+template<typename Lock>
+class FecWindowEncodeT {
+ public:
+  ///deadline_ms a sparse stream still gets repair packets this long after its last
+  ///unprotected source packet, adaptive lets @func OnFeedback move interval
+  FecWindowEncodeT(const int32_t& window, const int32_t& interval, const int32_t& repair_pkg_num = 1,
+                   const uint32_t& deadline_ms = 30, const bool& adaptive = false);
+  ~FecWindowEncodeT();
+  ///return 1 means the source packet, and maybe repair packets, are ready for Output
+  int32_t Input(const char* input_data_pkg, int32_t length);
+  ///the pointers stay valid until the next Input, which drops whatever was not fetched
+  int32_t Output(std::vector<char*>& data_pkgs, std::vector<int32_t>& data_pkgs_length);
+  ///@return positive when source packets have waited deadline_ms for repair, call
+  ///@func FlushUnEncodedData next, -1 if time goes backwards
+  int32_t FecEncodeUpdateTime(const uint64_t& cur_millsec);
+  ///see FecEncode::NextDeadline, -1 if every source packet is covered by repair packets
+  int64_t NextDeadline();
+  ///sends repair packets over the source packets not covered by any yet
+  int32_t FlushUnEncodedData(std::vector<char*>& data_pkgs, std::vector<int32_t>& data_pkg_length);
+  /**
+   * a loss report of the peer's FecDecode, sends repair packets after fewer source
+   * packets when the loss goes up, so they make up about twice the loss rate
+   * @note the interval drops at once, but grows back by one per report
+   */
+  void OnFeedback(const FecFeedback& feedback);
+ private:
+  void EncodeRepairs();
+  ///makes slot at least length bytes
+  static char *SlotOf(std::vector<char>& slot, const size_t& length);
+ private:
+  Lock mutex_;
+  const int32_t window_;
+  ///source packets per round of repair packets
+  int32_t interval_;
+  const int32_t repair_pkg_num_;
+  const uint32_t deadline_ms_;
+  typename FecLockTraits<Lock>::template Atomic<uint_least64_t> inside_timer_;
+  ///ring of the last window source packets, header included
+  std::vector<std::vector<char>> sources_;
+  std::vector<int32_t> sources_length_;
+  ///slot of the next source packet
+  int32_t head_;
+  std::vector<std::vector<char>> repairs_;
+  std::vector<int32_t> repairs_length_;
+  ///packets waiting for Output
+  std::vector<char *> pending_pkgs_;
+  std::vector<int32_t> pending_length_;
+  ///esi of the next source packet
+  uint16_t esi_;
+  ///source packets sent so far, saturates at window
+  int32_t sent_num_;
+  ///source packets since the last repair packets
+  int32_t unprotected_num_;
+  int64_t unprotected_since_ms_;
+  uint8_t seed_;
+  const bool adaptive_;
+  ///smoothed loss rate of the reports
+  double loss_;
+};
+
+///instantiated in fec_window_encode.cpp for these two only
+typedef FecWindowEncodeT<std::mutex> FecWindowEncode;
+typedef FecWindowEncodeT<NullLock> SingleThreadFecWindowEncode;
+
+#endif //LIBFEC_FEC_WINDOW_ENCODE_H
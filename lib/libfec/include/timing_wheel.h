@@ -0,0 +1,72 @@
+//
+// Created by lwj on 2020/3/22.
+//
+
+#ifndef LIBFEC_TIMING_WHEEL_H
+#define LIBFEC_TIMING_WHEEL_H
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include "noncopyable.h"
+
+///a timer of TimingWheel, embedded in whatever it times out so that scheduling allocates
+///nothing, all zero means not scheduled
+struct TimingWheelTimer {
+  TimingWheelTimer *prev;
+  TimingWheelTimer *next;
+  uint64_t expire_tick;
+  ///left to the owner to find itself back on expiry, e.g. a seq or an index
+  uint64_t data;
+};
+
+/**
+ * hierarchical timing wheel, 4 levels of 64 slots, a timer sits in the slot of the level
+ * its distance falls into and moves down one level each time the lower level wraps, so
+ * Schedule, Cancel and the expiry of a timer are O(1) whatever the number of timers
+ * the wheel has no clock of its own, it moves when the event loop calls Advance with its
+ * time, timers due are handed back from there
+ * @note not thread safe, meant for one event loop, e.g. FecDecode group expiry, idle
+ * stream reaping or kcp session deadlines
+ */
+class TimingWheel : noncopyable {
+ public:
+  ///tick_ms is the resolution, a timer fires on the first Advance at least its delay later
+  explicit TimingWheel(const uint64_t &now_ms, const uint32_t &tick_ms = 1);
+  ///(re)schedules timer to fire delay_ms after the time of the last Advance
+  void Schedule(TimingWheelTimer *timer, const uint64_t &delay_ms);
+  ///nothing happens if timer is not scheduled
+  void Cancel(TimingWheelTimer *timer);
+  static bool Scheduled(const TimingWheelTimer *timer) { return timer->next != nullptr; }
+  /**
+   * moves the wheel to now_ms and calls on_expire with every timer that became due, the
+   * timer is no longer scheduled by then, on_expire may schedule or cancel any timer
+   * @return the number of timers expired
+   */
+  int32_t Advance(const uint64_t &now_ms, const std::function<void(TimingWheelTimer *)> &on_expire);
+  ///time of the last Advance
+  uint64_t Now() const { return now_ms_; }
+  int32_t Size() const { return size_; }
+ private:
+  ///puts timer in the slot its expire_tick falls into from current_tick_
+  void Link(TimingWheelTimer *timer);
+  static void Unlink(TimingWheelTimer *timer);
+  ///relinks every timer of slot index of level one level lower
+  void Cascade(const int32_t &level, const int32_t &index);
+  TimingWheelTimer *Slot(const int32_t &level, const int32_t &index) {
+      return &slots_[level * kWheelSlots + index];
+  }
+ private:
+  static const int32_t kWheelBits = 6;
+  static const int32_t kWheelSlots = 1 << kWheelBits;
+  static const int32_t kWheelLevels = 4;
+  const uint32_t tick_ms_;
+  ///list heads of the slots, level by level
+  std::vector<TimingWheelTimer> slots_;
+  ///every timer due up to current_tick_ has expired
+  uint64_t current_tick_;
+  uint64_t now_ms_;
+  int32_t size_;
+};
+
+#endif //LIBFEC_TIMING_WHEEL_H
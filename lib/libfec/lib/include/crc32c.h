@@ -0,0 +1,29 @@
+/*
+ * crc32c.h
+ *
+ * CRC-32C (Castagnoli, polynomial 0x1EDC6F41) as used by iSCSI and SCTP,
+ * with the SSE4.2 crc32 instruction when the cpu has it and slicing by 8
+ * tables otherwise.
+ */
+
+#ifndef LIB_CRC32C_H_
+#define LIB_CRC32C_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+void init_crc32c() ;  //if you never called this,it will be automatically called in crc32c()
+
+// crc, the crc32c of the data before, 0 to start
+// return the crc32c of the data before followed by data[0.....length-1]
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_CRC32C_H_ */
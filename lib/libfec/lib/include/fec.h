@@ -52,7 +52,11 @@ void * fec_new(int k, int n) ;//n>=k
 
 void init_fec() ;  //if you never called this,it will be automatically called in fec_new()
 void fec_encode(void *code, void *src[], void *dst, int index, int sz) ;
+void fec_encode_parity(void *code, void *src[], void *fec[], int sz) ;  //all n-k parity packets in one pass, fec[j] is index k+j
+void fec_mul_rows(const unsigned char *coef, void *src[], int k, void *dst[], int g, int sz) ;  //dst[j] = sum coef[j*k+i]*src[i], GF_BITS 8 only
 int fec_decode(void *code, void *pkt[], int index[], int sz) ;
+void fec_xor(void *dst, const void *src, int sz) ;  //dst[] ^= src[], sz in bytes
+void fec_addmul(void *dst, const void *src, int c, int sz) ;  //dst[] ^= c*src[], GF_BITS 8 only
 
 int get_k(void *code);
 int get_n(void *code);
@@ -0,0 +1,59 @@
+/*
+ * fec16.h
+ *
+ * Reed-Solomon erasure code over GF(2^16) in the novel polynomial basis of
+ * Lin, Chung and Han, the way Leopard-RS does it: parity is an additive FFT
+ * of the data instead of a vandermonde matrix product, so encoding and
+ * decoding cost O(n log n) per symbol and a group may hold up to 65536
+ * shards instead of 256.
+ *
+ * Shards are arrays of 16 bits symbols (little endian), size must be even.
+ * The codec is not compatible with the vandermonde one of fec.h, both ends
+ * of a group have to use the same.
+ */
+
+#ifndef LIB_FEC16_H_
+#define LIB_FEC16_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define FEC16_MAX_SHARDS 65536
+
+void init_fec16() ;  //if you never called this,it will be automatically called by the functions below
+
+// bytes of the work area fec16_encode needs for a (k, k+m) code of size bytes shards
+size_t fec16_encode_work_size(int k, int m, int size) ;
+
+// bytes of the work area fec16_decode needs
+size_t fec16_decode_work_size(int k, int m, int size) ;
+
+// input:
+// data[0....k-1 ], points to original data
+// size, data length, even
+// work, fec16_encode_work_size() bytes
+//
+// output:
+// data[k....k+m-1], points to generated redundant data
+//
+// info:
+// return zero on success, non-zero if (k, m, size) is out of range
+int fec16_encode(int k, int m, char *data[], int size, void *work) ;
+
+// same contract as rs_decode() with n=k+m:
+// data[0.....k+m-1] points to original data and redundant data, missing ones are 0,
+// after the call data[0.....k-1] point to the recovered original data, rebuilt
+// ones reuse the memory of the redundant data
+//
+// info:
+// return zero on success, non-zero if fewer than k pointers are given
+int fec16_decode(int k, int m, char *data[], int size, void *work) ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB_FEC16_H_ */
@@ -0,0 +1,139 @@
+/*
+ * fec_codec.h
+ *
+ * FecCodec<K, M> is the (K, K+M) code of fec_new() with its parity rows
+ * computed by the compiler, so encoding needs no code object and no
+ * get_code() lookup. Decoding still goes through the cached inverse
+ * matrices of fec_decode().
+ *
+ * Only the matrix is compile-time: the multiply itself is the runtime
+ * dispatched, register-blocked kernel of fec_mul_rows(). A per (K, M)
+ * loop of fec_addmul() unrolled here measured 0-20% slower, it reads
+ * every source once per parity row instead of once per column block.
+ */
+
+#ifndef LIB_FEC_CODEC_H_
+#define LIB_FEC_CODEC_H_
+
+#include "gf_tables.h"
+#include "rs.h"
+
+namespace fec_gf {
+
+template<int K, int M>
+struct ParityMatrix {
+  unsigned char coef[M * K];
+};
+
+/* same steps as fec_new(): vandermonde rows, invert_vdm() of the top
+ * K*K block, then the bottom M rows times that inverse */
+template<int K, int M>
+constexpr ParityMatrix<K, M> MakeParityMatrix() {
+    unsigned char vdm[(K + M) * K] = {};
+    vdm[0] = 1;
+    for (int row = 0; row < K + M - 1; row++)
+        for (int col = 0; col < K; col++)
+            vdm[(row + 1) * K + col] = Exp(row * col);
+
+    if (K > 1) {
+        unsigned char c[K] = {}, b[K] = {}, p[K] = {};
+        for (int i = 0; i < K; i++)
+            p[i] = vdm[i * K + 1];
+        c[K - 1] = p[0];
+        for (int i = 1; i < K; i++) {
+            for (int j = K - i; j < K - 1; j++)
+                c[j] ^= Mul(p[i], c[j + 1]);
+            c[K - 1] ^= p[i];
+        }
+        for (int row = 0; row < K; row++) {
+            unsigned char xx = p[row], t = 1;
+            b[K - 1] = 1;
+            for (int i = K - 2; i >= 0; i--) {
+                b[i] = c[i + 1] ^ Mul(xx, b[i + 1]);
+                t = Mul(xx, t) ^ b[i];
+            }
+            for (int col = 0; col < K; col++)
+                vdm[col * K + row] = Mul(Inverse(t), b[col]);
+        }
+    }
+
+    ParityMatrix<K, M> m{};
+    for (int row = 0; row < M; row++)
+        for (int col = 0; col < K; col++) {
+            unsigned char acc = 0;
+            for (int i = 0; i < K; i++)
+                acc ^= Mul(vdm[(K + row) * K + i], vdm[i * K + col]);
+            m.coef[row * K + col] = acc;
+        }
+    return m;
+}
+
+}
+
+template<int K, int M>
+class FecCodec {
+ public:
+  static_assert(K >= 1 && M >= 1 && K + M <= 255, "invalid (k, m)");
+
+  static constexpr int kDataNum = K;
+  static constexpr int kParityNum = M;
+  static constexpr fec_gf::ParityMatrix<K, M> kParity = fec_gf::MakeParityMatrix<K, M>();
+
+  /// data[0..K-1] in, data[K..K+M-1] out, same contract as rs_encode
+  static void Encode(char *data[], int size) {
+      fec_mul_rows(kParity.coef, reinterpret_cast<void **>(data), K,
+                   reinterpret_cast<void **>(data + K), M, size);
+  }
+
+  /// same contract as rs_decode
+  static int Decode(char *data[], int size) {
+      return rs_decode2(K, K + M, data, size);
+  }
+};
+
+template<int K, int M>
+constexpr fec_gf::ParityMatrix<K, M> FecCodec<K, M>::kParity;
+
+static_assert(FecCodec<2, 1>::kParity.coef[0] == 3 && FecCodec<2, 1>::kParity.coef[1] == 2,
+              "parity rows differ from fec_new()");
+static_assert(FecCodec<3, 1>::kParity.coef[0] == 15 && FecCodec<3, 1>::kParity.coef[1] == 8 &&
+              FecCodec<3, 1>::kParity.coef[2] == 6, "parity rows differ from fec_new()");
+
+/// the shapes a caller actually encodes with, as a list of FecCodec, so
+/// the compile-time matrices follow the shapes that are in use instead of
+/// a hand-written guess. Encode() picks the codec matching (k, m) at run
+/// time and returns -1 when none does, the caller then falls back to
+/// rs_encode2
+template<typename... Codecs>
+struct FecCodecSet;
+
+template<>
+struct FecCodecSet<> {
+  static constexpr int kSize = 0;
+
+  static int Encode(int, int, char *[], int) { return -1; }
+};
+
+template<typename Codec, typename... Rest>
+struct FecCodecSet<Codec, Rest...> {
+  static constexpr int kSize = 1 + sizeof...(Rest);
+
+  static int Encode(int k, int m, char *data[], int size) {
+      if (k == Codec::kDataNum && m == Codec::kParityNum) {
+          Codec::Encode(data, size);
+          return 0;
+      }
+      return FecCodecSet<Rest...>::Encode(k, m, data, size);
+  }
+};
+
+/// the (2, 1) groups the kcptunnel endpoints send by default
+typedef FecCodecSet<FecCodec<2, 1>> FecDefaultCodecs;
+
+/// encodes with the compile-time matrix when (k, m) is one of
+/// FecDefaultCodecs, returns -1 otherwise
+inline int FecCodecEncode(int k, int m, char *data[], int size) {
+    return FecDefaultCodecs::Encode(k, m, data, size);
+}
+
+#endif /* LIB_FEC_CODEC_H_ */
@@ -0,0 +1,90 @@
+/*
+ * gf_tables.h
+ *
+ * GF(2^8) arithmetic tables of fec.c, generated at compile time by the
+ * constexpr functions below (see gf_tables.cpp) instead of by
+ * generate_gf()/init_mul_table() on first use.
+ */
+
+#ifndef LIB_GF_TABLES_H_
+#define LIB_GF_TABLES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct fec_gf_tables {
+  unsigned char mul_nibble[256][2][16]; /* c*i and c*(i<<4), for the pshufb kernels */
+  unsigned char mul[256][256];
+  unsigned char exp[2 * 255];           /* extended, exp[i + 255] == exp[i] */
+  unsigned char inverse[256];
+  int log[256];                         /* log[0] == 255 */
+};
+
+extern const struct fec_gf_tables fec_gf_tables;
+
+#ifdef __cplusplus
+}
+
+namespace fec_gf {
+
+/* 1+x^2+x^3+x^4+x^8, allPp[8] of fec.c */
+constexpr const char *kPrimitivePoly = "101110001";
+
+struct ExpLog {
+  unsigned char exp[2 * 255];
+  int log[256];
+};
+
+constexpr int Modnn(int x) {
+    while (x >= 255) {
+        x -= 255;
+        x = (x >> 8) + (x & 255);
+    }
+    return x;
+}
+
+/* same steps as generate_gf() */
+constexpr ExpLog MakeExpLog() {
+    ExpLog t{};
+    unsigned char mask = 1;
+    t.exp[8] = 0;
+    for (int i = 0; i < 8; i++, mask <<= 1) {
+        t.exp[i] = mask;
+        t.log[t.exp[i]] = i;
+        if (kPrimitivePoly[i] == '1')
+            t.exp[8] ^= mask;
+    }
+    t.log[t.exp[8]] = 8;
+    mask = 1 << 7;
+    for (int i = 9; i < 255; i++) {
+        if (t.exp[i - 1] >= mask)
+            t.exp[i] = t.exp[8] ^ static_cast<unsigned char>((t.exp[i - 1] ^ mask) << 1);
+        else
+            t.exp[i] = static_cast<unsigned char>(t.exp[i - 1] << 1);
+        t.log[t.exp[i]] = i;
+    }
+    t.log[0] = 255;
+    for (int i = 0; i < 255; i++)
+        t.exp[i + 255] = t.exp[i];
+    return t;
+}
+
+constexpr ExpLog kExpLog = MakeExpLog();
+
+constexpr unsigned char Mul(int x, int y) {
+    return (x == 0 || y == 0) ? 0 : kExpLog.exp[Modnn(kExpLog.log[x] + kExpLog.log[y])];
+}
+
+constexpr unsigned char Inverse(int x) {
+    return x <= 1 ? static_cast<unsigned char>(x) : kExpLog.exp[255 - kExpLog.log[x]];
+}
+
+constexpr unsigned char Exp(int i) {
+    return kExpLog.exp[Modnn(i)];
+}
+
+}
+#endif
+
+#endif /* LIB_GF_TABLES_H_ */
@@ -49,6 +49,19 @@ void rs_encode2(int k,int n,char *data[],int size);
 int rs_decode2(int k,int n,char *data[],int size);
 
 
+// single parity xor code, n is always k+1 and needs no code object
+//
+// xor_encode:
+// data[0.....k-1] points to original data, data[k] gets their xor
+//
+// xor_decode:
+// same contract as rs_decode with n=k+1: at most one of data[0.....k] may be
+// zero, the missing data is rebuilt in the memory of data[k]
+void xor_encode(int k,char *data[],int size);
+
+int xor_decode(int k,char *data[],int size);
+
+
 #ifdef __cplusplus
 }
 #endif
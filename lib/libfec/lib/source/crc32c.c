@@ -0,0 +1,98 @@
+/*
+ * crc32c.c
+ *
+ * CRC-32C of fec shards, checked before a shard is admitted to its group,
+ * so the cost has to stay small next to the copy of the shard itself.
+ */
+#include "crc32c.h"
+#include "string.h"
+
+/*
+ * x86 builds carry an SSE4.2 version of crc32c(), compiled with a
+ * per-function target attribute and picked at runtime in init_crc32c()
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 6))
+#define CRC32C_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* reflected 0x1EDC6F41 */
+#define CRC32C_POLYNOMIAL 0x82F63B78u
+
+/* crc32c_table[n][b] is the crc of byte b followed by n zero bytes */
+static uint32_t crc32c_table[8][256];
+
+static int crc32c_initialized = 0;
+
+static uint32_t
+crc32c_sw(uint32_t crc, const unsigned char *p, size_t length) {
+    for (; length > 0 && ((uintptr_t) p & 7) != 0; length--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    /* slicing by 8, the word is read little endian byte by byte so the
+     * result does not depend on the host byte order */
+    for (; length >= 8; length -= 8, p += 8) {
+        const uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+        crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+              crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^ crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^ crc32c_table[0][p[7]];
+    }
+    for (; length > 0; length--)
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const unsigned char *p, size_t length);
+
+static crc32c_fn crc32c1 = crc32c_sw;
+
+#ifdef CRC32C_X86_SIMD
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *p, size_t length) {
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; length >= 8; length -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+#endif
+    for (; length >= 4; length -= 4, p += 4) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; length > 0; length--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif /* CRC32C_X86_SIMD */
+
+void
+init_crc32c() {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        crc32c_table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+        for (int n = 1; n < 8; n++)
+            crc32c_table[n][b] = crc32c_table[0][crc32c_table[n - 1][b] & 0xff] ^ (crc32c_table[n - 1][b] >> 8);
+#ifdef CRC32C_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        crc32c1 = crc32c_sse42;
+#endif
+    crc32c_initialized = 1;
+}
+
+uint32_t
+crc32c(uint32_t crc, const void *data, size_t length) {
+    if (crc32c_initialized == 0)
+        init_crc32c();
+    return ~crc32c1(~crc, (const unsigned char *) data, length);
+}
@@ -45,6 +45,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "gf_tables.h"
+
+/*
+ * x86 builds carry SSSE3/AVX2/AVX-512BW versions of addmul1(), compiled
+ * with per-function target attributes and picked at runtime in init_fec()
+ */
+#if (GF_BITS == 8) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 6))
+#define FEC_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 void print_char_array_in_byte(char *buf, int length, char *name) {
     const int32_t size = sizeof(buf);
@@ -145,6 +158,7 @@ typedef unsigned short gf;
  */
 ///这个实际上对应的是GF(2^x)的素多项式,x就是索引,本库中默认索引是8,素多项式也就是1+x^2+x^3+x^4+x^8
 ///不过实际上GF(2^8)的素多项式也不只有一个,这里只是选了一个最出名的
+#if (GF_BITS != 8)
 static const char *allPp[] = {    /* GF_BITS	polynomial		*/
     NULL,            /*  0	no code			*/
     NULL,            /*  1	no code			*/
@@ -164,6 +178,7 @@ static const char *allPp[] = {    /* GF_BITS	polynomial		*/
     "1100000000000001",        /* 15	1+x+x^15		*/
     "11010000000010001"        /* 16	1+x+x^3+x^12+x^16	*/
 };
+#endif
 
 /*
  * To speed up computations, we have tables for logarithm, exponent
@@ -174,6 +189,15 @@ static const char *allPp[] = {    /* GF_BITS	polynomial		*/
  * In any case the macro gf_mul(x,y) takes care of multiplications.
  */
 
+#if (GF_BITS == 8)
+/*
+ * GF(2^8) tables are constant data generated by the compiler, see
+ * gf_tables.cpp; they are laid out exactly like the ones below.
+ */
+#define gf_exp fec_gf_tables.exp
+#define gf_log fec_gf_tables.log
+#define inverse fec_gf_tables.inverse
+#else
 ///指数对应到多项式的表,假设指数为x则对应多项式为g^x,系数就是gf_exp[x]对应的值,对应到2进制作为系数,
 /// 比如45就是二进制的00101101,对应多项式其实就是a^5+a^3+a^2+1
 static gf gf_exp[2 * GF_SIZE];    /* index->poly form conversion table	*/
@@ -183,6 +207,7 @@ static int gf_log[GF_SIZE + 1];    /* Poly->index form conversion table	*/
 ///的值为g^(255-k)对应的多项式系数
 static gf inverse[GF_SIZE + 1];    /* inverse of field elem.		*/
 /* inv[\alpha**i]=\alpha**(GF_SIZE-i-1)	*/
+#endif
 
 /*
  * modnn(x) computes x % GF_SIZE, where GF_SIZE is 2**GF_BITS - 1,
@@ -209,15 +234,23 @@ modnn(int x) {
  * A value related to the multiplication is held in a local variable
  * declared with USE_GF_MULC . See usage in addmul1().
  */
-#if (GF_BITS <= 8)
+#if (GF_BITS == 8)
+#define gf_mul_table fec_gf_tables.mul
+#elif (GF_BITS < 8)
 static gf gf_mul_table[GF_SIZE + 1][GF_SIZE + 1];
+#endif
+
+#if (GF_BITS <= 8)
 
 #define gf_mul(x, y) gf_mul_table[x][y]
 
-#define USE_GF_MULC register gf * __gf_mulc_
+#define USE_GF_MULC register const gf * __gf_mulc_
 #define GF_MULC0(c) __gf_mulc_ = gf_mul_table[c]
 #define GF_ADDMULC(dst, x) dst ^= __gf_mulc_[x]
 
+#if (GF_BITS == 8)
+#define init_mul_table()
+#else
 static void
 init_mul_table() {
     int i, j;
@@ -228,6 +261,7 @@ init_mul_table() {
     for (j = 0; j < GF_SIZE + 1; j++)
         gf_mul_table[0][j] = gf_mul_table[j][0] = 0;
 }
+#endif
 #else	/* GF_BITS > 8 */
 static inline gf
 gf_mul(x,y)
@@ -238,7 +272,7 @@ gf_mul(x,y)
 }
 #define init_mul_table()
 
-#define USE_GF_MULC register gf * __gf_mulc_
+#define USE_GF_MULC register const gf * __gf_mulc_
 #define GF_MULC0(c) __gf_mulc_ = &gf_exp[ gf_log[c] ]
 #define GF_ADDMULC(dst, x) { if (x) dst ^= __gf_mulc_[ gf_log[x] ] ; }
 #endif
@@ -274,6 +308,9 @@ my_malloc(int sz, const char *err_string) {
 /*
  * initialize the data structures used for computations in GF.
  */
+#if (GF_BITS == 8)
+#define generate_gf()
+#else
 ///这个是按照https://www.zhihu.com/question/22072020来计算的
 static void
 generate_gf(void) {
@@ -336,6 +373,7 @@ generate_gf(void) {
     for (i = 2; i <= GF_SIZE; i++)
         inverse[i] = gf_exp[GF_SIZE - gf_log[i]];
 }
+#endif
 
 /*
  * Various linear algebra operations that i use often.
@@ -348,14 +386,19 @@ generate_gf(void) {
  * The case c=0 is also optimized, whereas c=1 is not. These
  * calls are unfrequent in my typical apps so I did not bother.
  * 
- * Note that gcc on
+ * addmul1 points to the scalar loop below or, on x86, to one of the
+ * pshufb kernels selected by init_fec().
  */
 #define addmul(dst, src, c, sz) \
     if (c != 0) addmul1(dst, src, c, sz)
 
+typedef void (*addmul_fn)(gf *dst, gf *src, gf c, int sz);
+
+#define FEC_MAX_ACC 8 /* parity outputs per pass of a register-blocked kernel */
+
 #define UNROLL 16 /* 1, 4, 8, 16 */
 static void
-addmul1(gf *dst1, gf *src1, gf c, int sz) {
+addmul1_scalar(gf *dst1, gf *src1, gf c, int sz) {
     USE_GF_MULC;
     register gf *dst = dst1, *src = src1;
     gf *lim = &dst[sz - UNROLL + 1];
@@ -391,6 +434,283 @@ addmul1(gf *dst1, gf *src1, gf c, int sz) {
         GF_ADDMULC(*dst, *src);
 }
 
+static addmul_fn addmul1 = addmul1_scalar;
+
+#ifdef FEC_X86_SIMD
+/*
+ * Split-nibble multiply: c*x = c*(x & 0x0f) ^ c*(x & 0xf0), so two
+ * 16-entry tables per constant turn a whole vector of products into
+ * two pshufb lookups. gf_mul_nibble[c][0] holds c*i, [c][1] c*(i<<4).
+ * It is the first member of the 64-byte aligned fec_gf_tables, so every
+ * 16-entry row can be loaded aligned.
+ */
+#define gf_mul_nibble fec_gf_tables.mul_nibble
+
+__attribute__((target("ssse3")))
+static void
+addmul1_ssse3(gf *dst, gf *src, gf c, int sz) {
+    const __m128i tlo = _mm_load_si128((const __m128i *) gf_mul_nibble[c][0]);
+    const __m128i thi = _mm_load_si128((const __m128i *) gf_mul_nibble[c][1]);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i lo = _mm_shuffle_epi8(tlo, _mm_and_si128(x, mask));
+        __m128i hi = _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i));
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(d, _mm_xor_si128(lo, hi)));
+    }
+    if (i < sz)
+        addmul1_scalar(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx2")))
+static void
+addmul1_avx2(gf *dst, gf *src, gf c, int sz) {
+    const __m256i tlo = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *) gf_mul_nibble[c][0]));
+    const __m256i thi = _mm256_broadcastsi128_si256(
+        _mm_load_si128((const __m128i *) gf_mul_nibble[c][1]));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+        __m256i p0 = _mm256_xor_si256(
+            _mm256_shuffle_epi8(tlo, _mm256_and_si256(x0, mask)),
+            _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x0, 4), mask)));
+        __m256i p1 = _mm256_xor_si256(
+            _mm256_shuffle_epi8(tlo, _mm256_and_si256(x1, mask)),
+            _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x1, 4), mask)));
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i)), p0));
+        _mm256_storeu_si256((__m256i *) (dst + i + 32),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i + 32)), p1));
+    }
+    for (; i + 32 <= sz; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i p = _mm256_xor_si256(
+            _mm256_shuffle_epi8(tlo, _mm256_and_si256(x, mask)),
+            _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (dst + i)), p));
+    }
+    if (i < sz)
+        addmul1_scalar(dst + i, src + i, c, sz - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void
+addmul1_avx512(gf *dst, gf *src, gf c, int sz) {
+    const __m512i tlo = _mm512_broadcast_i32x4(
+        _mm_load_si128((const __m128i *) gf_mul_nibble[c][0]));
+    const __m512i thi = _mm512_broadcast_i32x4(
+        _mm_load_si128((const __m128i *) gf_mul_nibble[c][1]));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    int i = 0;
+
+    for (; i + 64 <= sz; i += 64) {
+        __m512i x = _mm512_loadu_si512((const void *) (src + i));
+        __m512i p = _mm512_xor_si512(
+            _mm512_shuffle_epi8(tlo, _mm512_and_si512(x, mask)),
+            _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask)));
+        _mm512_storeu_si512((void *) (dst + i),
+                            _mm512_xor_si512(_mm512_loadu_si512((const void *) (dst + i)), p));
+    }
+    if (i < sz) {
+        /* masked tail, the bytes past sz are neither read nor written */
+        __mmask64 m = (__mmask64) (~0ULL >> (64 - (sz - i)));
+        __m512i x = _mm512_maskz_loadu_epi8(m, (const void *) (src + i));
+        __m512i p = _mm512_xor_si512(
+            _mm512_shuffle_epi8(tlo, _mm512_and_si512(x, mask)),
+            _mm512_shuffle_epi8(thi, _mm512_and_si512(_mm512_srli_epi64(x, 4), mask)));
+        __m512i d = _mm512_maskz_loadu_epi8(m, (const void *) (dst + i));
+        _mm512_mask_storeu_epi8((void *) (dst + i), m, _mm512_xor_si512(d, p));
+    }
+}
+
+/*
+ * Register-blocked parity kernels for fec_encode_parity(): for every
+ * vector-sized column the nibbles of each source are split once and
+ * accumulated into up to FEC_MAX_ACC parity registers, each parity
+ * byte is stored once instead of being read and written k times.
+ * coef points to g rows of k coefficients. Returns the bytes done,
+ * the caller finishes the tail.
+ */
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) int
+encode_rows_avx2_g(gf **src, int k, gf **fec, const int g, const gf *coef, int sz) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    int off, i, j;
+
+    for (off = 0; off + 32 <= sz; off += 32) {
+        __m256i acc[FEC_MAX_ACC];
+        for (j = 0; j < g; j++)
+            acc[j] = _mm256_setzero_si256();
+        for (i = 0; i < k; i++) {
+            __m256i x = _mm256_loadu_si256((const __m256i *) (src[i] + off));
+            __m256i lo = _mm256_and_si256(x, mask);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+            for (j = 0; j < g; j++) {
+                const gf *t = gf_mul_nibble[coef[j * k + i]][0];
+                __m256i tlo = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) t));
+                __m256i thi = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) (t + 16)));
+                acc[j] = _mm256_xor_si256(acc[j], _mm256_xor_si256(
+                    _mm256_shuffle_epi8(tlo, lo), _mm256_shuffle_epi8(thi, hi)));
+            }
+        }
+        for (j = 0; j < g; j++)
+            _mm256_storeu_si256((__m256i *) (fec[j] + off), acc[j]);
+    }
+    return off;
+}
+
+__attribute__((target("avx2")))
+static int
+encode_rows_avx2(gf **src, int k, gf **fec, int g, const gf *coef, int sz) {
+    /* constant g lets the accumulators live in registers */
+    switch (g) {
+    case 1: return encode_rows_avx2_g(src, k, fec, 1, coef, sz);
+    case 2: return encode_rows_avx2_g(src, k, fec, 2, coef, sz);
+    case 3: return encode_rows_avx2_g(src, k, fec, 3, coef, sz);
+    case 4: return encode_rows_avx2_g(src, k, fec, 4, coef, sz);
+    case 5: return encode_rows_avx2_g(src, k, fec, 5, coef, sz);
+    case 6: return encode_rows_avx2_g(src, k, fec, 6, coef, sz);
+    case 7: return encode_rows_avx2_g(src, k, fec, 7, coef, sz);
+    default: return encode_rows_avx2_g(src, k, fec, 8, coef, sz);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __attribute__((always_inline)) int
+encode_rows_avx512_g(gf **src, int k, gf **fec, const int g, const gf *coef, int sz) {
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    int off, i, j;
+
+    for (off = 0; off + 64 <= sz; off += 64) {
+        __m512i acc[FEC_MAX_ACC];
+        for (j = 0; j < g; j++)
+            acc[j] = _mm512_setzero_si512();
+        for (i = 0; i < k; i++) {
+            __m512i x = _mm512_loadu_si512((const void *) (src[i] + off));
+            __m512i lo = _mm512_and_si512(x, mask);
+            __m512i hi = _mm512_and_si512(_mm512_srli_epi64(x, 4), mask);
+            for (j = 0; j < g; j++) {
+                const gf *t = gf_mul_nibble[coef[j * k + i]][0];
+                __m512i tlo = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *) t));
+                __m512i thi = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i *) (t + 16)));
+                acc[j] = _mm512_xor_si512(acc[j], _mm512_xor_si512(
+                    _mm512_shuffle_epi8(tlo, lo), _mm512_shuffle_epi8(thi, hi)));
+            }
+        }
+        for (j = 0; j < g; j++)
+            _mm512_storeu_si512((void *) (fec[j] + off), acc[j]);
+    }
+    return off;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int
+encode_rows_avx512(gf **src, int k, gf **fec, int g, const gf *coef, int sz) {
+    /* constant g lets the accumulators live in registers */
+    switch (g) {
+    case 1: return encode_rows_avx512_g(src, k, fec, 1, coef, sz);
+    case 2: return encode_rows_avx512_g(src, k, fec, 2, coef, sz);
+    case 3: return encode_rows_avx512_g(src, k, fec, 3, coef, sz);
+    case 4: return encode_rows_avx512_g(src, k, fec, 4, coef, sz);
+    case 5: return encode_rows_avx512_g(src, k, fec, 5, coef, sz);
+    case 6: return encode_rows_avx512_g(src, k, fec, 6, coef, sz);
+    case 7: return encode_rows_avx512_g(src, k, fec, 7, coef, sz);
+    default: return encode_rows_avx512_g(src, k, fec, 8, coef, sz);
+    }
+}
+#endif /* FEC_X86_SIMD */
+
+typedef int (*encode_rows_fn)(gf **src, int k, gf **fec, int g, const gf *coef, int sz);
+static encode_rows_fn encode_rows = NULL;
+
+/*
+ * xor1() computes dst[] ^= src[] over sz bytes, the whole arithmetic of
+ * the single parity code. No tables: 64-bit words, or full vectors on
+ * x86 picked by init_addmul() like addmul1.
+ */
+typedef void (*xor_fn)(unsigned char *dst, const unsigned char *src, int sz);
+
+static void
+xor1_scalar(unsigned char *dst, const unsigned char *src, int sz) {
+    int i = 0;
+    for (; i + 8 <= sz; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < sz; i++)
+        dst[i] ^= src[i];
+}
+
+#ifdef FEC_X86_SIMD
+__attribute__((target("avx2")))
+static void
+xor1_avx2(unsigned char *dst, const unsigned char *src, int sz) {
+    int i = 0;
+    for (; i + 64 <= sz; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (dst + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (dst + i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *) (src + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *) (src + i + 32));
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(a0, b0));
+        _mm256_storeu_si256((__m256i *) (dst + i + 32), _mm256_xor_si256(a1, b1));
+    }
+    if (i < sz)
+        xor1_scalar(dst + i, src + i, sz - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void
+xor1_avx512(unsigned char *dst, const unsigned char *src, int sz) {
+    int i = 0;
+    for (; i + 64 <= sz; i += 64) {
+        __m512i a = _mm512_loadu_si512((const void *) (dst + i));
+        __m512i b = _mm512_loadu_si512((const void *) (src + i));
+        _mm512_storeu_si512((void *) (dst + i), _mm512_xor_si512(a, b));
+    }
+    if (i < sz) {
+        __mmask64 m = (__mmask64) (~0ULL >> (64 - (sz - i)));
+        __m512i a = _mm512_maskz_loadu_epi8(m, (const void *) (dst + i));
+        __m512i b = _mm512_maskz_loadu_epi8(m, (const void *) (src + i));
+        _mm512_mask_storeu_epi8((void *) (dst + i), m, _mm512_xor_si512(a, b));
+    }
+}
+#endif /* FEC_X86_SIMD */
+
+static xor_fn xor1 = xor1_scalar;
+
+/*
+ * pick the widest addmul1 the cpu (and os) supports
+ */
+static void
+init_addmul() {
+#ifdef FEC_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        addmul1 = addmul1_avx512;
+        encode_rows = encode_rows_avx512;
+        xor1 = xor1_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        addmul1 = addmul1_avx2;
+        encode_rows = encode_rows_avx2;
+        xor1 = xor1_avx2;
+    } else if (__builtin_cpu_supports("ssse3"))
+        addmul1 = addmul1_ssse3;
+    else
+#endif
+        addmul1 = addmul1_scalar;
+}
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -641,6 +961,7 @@ init_fec() {
     init_mul_table();
     TOCK(ticks[0]);
     DDB(fprintf(stderr, "init_mul_table took %ldus\n", ticks[0]);)
+    init_addmul();
     fec_initialized = 1;
 }
 
@@ -652,20 +973,48 @@ init_fec() {
 
 #define FEC_MAGIC    0xFECC0DEC
 
+/*
+ * Inverted decode matrices are cached per code, keyed by the index
+ * vector after shuffle(), since a lossy link keeps hitting the same
+ * few erasure patterns. Only the rows of the missing data packets are
+ * kept, packed so they can go straight to mul_rows().
+ */
+#define FEC_DEC_CACHE 16
+
+struct fec_dec_entry {
+  int *index;      /* k indexes after shuffle, NULL for an unused slot */
+  int *miss;       /* rows rebuilt from parity packets */
+  gf *rows;        /* nmiss rows of k coefficients */
+  int nmiss;
+  unsigned long used;
+};
+
 struct fec_parms {
   u_long magic;
   int k, n;        /* parameters of the code */
   gf *enc_matrix;
+  pthread_mutex_t lock;    /* decode cache and scratch */
+  struct fec_dec_entry dec_cache[FEC_DEC_CACHE];
+  unsigned long dec_clock;
+  gf *scratch;     /* output buffers of fec_decode */
+  int scratch_sz;
+  gf **scratch_pkt;
 };
 
 void
 fec_free(void *p0) {
     struct fec_parms *p = (struct fec_parms *) p0;
+    int i;
     if (p == NULL ||
         p->magic != (((FEC_MAGIC ^ p->k) ^ p->n) ^ (int) ((long) p->enc_matrix))) {
         fprintf(stderr, "bad parameters to fec_free\n");
         return;
     }
+    for (i = 0; i < FEC_DEC_CACHE; i++)
+        free(p->dec_cache[i].index);
+    free(p->scratch);
+    free(p->scratch_pkt);
+    pthread_mutex_destroy(&p->lock);
     free(p->enc_matrix);
     free(p);
 }
@@ -690,6 +1039,9 @@ fec_new(int k, int n) {
         return NULL;
     }
     retval = (struct fec_parms *) my_malloc(sizeof(struct fec_parms), "new_code");
+    bzero(retval, sizeof(struct fec_parms));
+    pthread_mutex_init(&retval->lock, NULL);
+    retval->scratch_pkt = (gf **) my_malloc(k * sizeof(gf *), "scratch pkt pointers");
     retval->k = k;
     retval->n = n;
     retval->enc_matrix = NEW_GF_MATRIX(n, k);
@@ -761,6 +1113,83 @@ fec_encode(void *code0, void *src0[], void *fec0, int index, int sz)
                 index, code->n - 1);
 }
 
+/*
+ * mul_rows() sets dst[j] = sum_i coef[j * k + i] * src[i] for g rows.
+ * With a register-blocked kernel every source column is read once for
+ * up to FEC_MAX_ACC outputs; otherwise the data is walked in tiles small
+ * enough that a tile of every source and every output stays in L1, and
+ * each source tile is accumulated into all the outputs before moving on.
+ */
+#define FEC_TILE_CACHE (32 * 1024)
+
+static void
+mul_rows(gf **src, int k, gf **dst, int g, const gf *coef, int sz)
+{
+    int i, j, tile, off, len, done = 0;
+
+    if (encode_rows != NULL) {
+        int j0, n;
+        for (j0 = 0; j0 < g; j0 += n) {
+            n = g - j0 < FEC_MAX_ACC ? g - j0 : FEC_MAX_ACC;
+            done = encode_rows(src, k, dst + j0, n, coef + j0 * k, sz);
+        }
+    }
+
+    tile = FEC_TILE_CACHE / (int) ((k + g) * sizeof(gf));
+    tile &= ~63;
+    if (tile < 256)
+        tile = 256;
+
+    for (j = 0; j < g; j++)
+        bzero(dst[j] + done, (sz - done) * sizeof(gf));
+
+    for (off = done; off < sz; off += tile) {
+        len = sz - off < tile ? sz - off : tile;
+        for (i = 0; i < k; i++) {
+            for (j = 0; j < g; j++) {
+                gf c = coef[j * k + i];
+                addmul(dst[j] + off, src[i] + off, c, len);
+            }
+        }
+    }
+}
+
+/*
+ * fec_encode_parity() computes all n-k parity packets in one pass over
+ * the data, fec[j] gets the packet with index k+j, the same bytes
+ * fec_encode() produces.
+ */
+void
+fec_encode_parity(void *code0, void *src0[], void *fec0[], int sz)
+{
+    struct fec_parms *code = (struct fec_parms *) code0;
+    int k = code->k, m = code->n - code->k;
+
+    if (GF_BITS > 8)
+        sz /= 2;
+    if (m <= 0)
+        return;
+
+    mul_rows((gf **) src0, k, (gf **) fec0, m, &code->enc_matrix[k * k], sz);
+}
+
+/*
+ * fec_mul_rows() is fec_encode_parity() with the g*k parity rows given
+ * by the caller instead of taken from a code object (see fec_codec.h)
+ */
+void
+fec_mul_rows(const unsigned char *coef, void *src0[], int k, void *dst0[], int g, int sz)
+{
+    if (fec_initialized == 0)
+        init_fec();
+    if (GF_BITS > 8)
+        sz /= 2;
+    if (g <= 0)
+        return;
+
+    mul_rows((gf **) src0, k, (gf **) dst0, g, (const gf *) coef, sz);
+}
+
 /*
  * shuffle move src packets in their position
  */
@@ -834,6 +1263,65 @@ build_decode_matrix(struct fec_parms *code, gf *pkt[], int index[]) {
     return matrix;
 }
 
+/*
+ * look up the cached decode rows for a shuffled index vector, building
+ * and inserting them (evicting the least recently used) on a miss.
+ * Called with code->lock held.
+ */
+static struct fec_dec_entry *
+dec_cache_get(struct fec_parms *code, gf *pkt[], int index[]) {
+    struct fec_dec_entry *e, *victim = NULL;
+    int i, row, k = code->k;
+    gf *m_dec;
+
+    /*
+     * fec_new() already bounds k, restated here so the compiler can bound
+     * the index copies and the k x k inversion below
+     */
+    if (k < 1 || k > GF_SIZE + 1)
+        return NULL;
+    for (i = 0; i < FEC_DEC_CACHE; i++) {
+        e = &code->dec_cache[i];
+        if (e->index == NULL) {
+            if (victim == NULL || victim->index != NULL)
+                victim = e;
+            continue;
+        }
+        if (memcmp(e->index, index, k * sizeof(int)) == 0) {
+            e->used = ++code->dec_clock;
+            return e;
+        }
+        if (victim == NULL || (victim->index != NULL && e->used < victim->used))
+            victim = e;
+    }
+
+    m_dec = build_decode_matrix(code, pkt, index);
+    if (m_dec == NULL)
+        return NULL;
+
+    e = victim;
+    if (e->index == NULL) {
+        /* one block per slot: index, miss and k rows of coefficients */
+        char *block = (char *) my_malloc(2 * k * sizeof(int) + k * k * sizeof(gf),
+                                         "decode cache entry");
+        e->index = (int *) block;
+        e->miss = e->index + k;
+        e->rows = (gf *) (e->miss + k);
+    }
+    bcopy(index, e->index, k * sizeof(int));
+    e->nmiss = 0;
+    for (row = 0; row < k; row++) {
+        if (index[row] >= k) {
+            e->miss[e->nmiss] = row;
+            bcopy(&m_dec[row * k], &e->rows[e->nmiss * k], k * sizeof(gf));
+            e->nmiss++;
+        }
+    }
+    e->used = ++code->dec_clock;
+    free(m_dec);
+    return e;
+}
+
 /*
  * fec_decode receives as input a vector of packets, the indexes of
  * packets, and produces the correct vector as output.
@@ -851,45 +1339,69 @@ fec_decode(void *code0, void *pkt0[], int index[], int sz)
 {
     struct fec_parms *code = (struct fec_parms *) code0;
     gf **pkt = (gf **) pkt0;
-    gf *m_dec;
-    gf **new_pkt;
-    int row, col, k = code->k;
+    struct fec_dec_entry *e;
+    int j, k = code->k;
 
     if (GF_BITS > 8)
         sz /= 2;
 
     if (shuffle(pkt, index, k))    /* error if true */
         return 1;
-    m_dec = build_decode_matrix(code, pkt, index);
 
-    if (m_dec == NULL)
+    pthread_mutex_lock(&code->lock);
+    e = dec_cache_get(code, pkt, index);
+    if (e == NULL) {
+        pthread_mutex_unlock(&code->lock);
         return 1; /* error */
-    /*
-     * do the actual decoding
-     */
-    new_pkt = (gf **) my_malloc(k * sizeof(gf *), "new pkt pointers");
-    for (row = 0; row < k; row++) {
-        if (index[row] >= k) {
-            new_pkt[row] = (gf *) my_malloc(sz * sizeof(gf), "new pkt buffer");
-            bzero(new_pkt[row], sz * sizeof(gf));
-            for (col = 0; col < k; col++)
-                addmul(new_pkt[row], pkt[col], m_dec[row * k + col], sz);
-        }
     }
-    /*
-     * move pkts to their final destination
-     */
-    for (row = 0; row < k; row++) {
-        if (index[row] >= k) {
-            bcopy(new_pkt[row], pkt[row], sz * sizeof(gf));
-            free(new_pkt[row]);
+    if (e->nmiss > 0) {
+        /*
+         * do the actual decoding into the per-code scratch buffers, the
+         * received parity packets are still needed as sources
+         */
+        if (code->scratch_sz < e->nmiss * sz) {
+            free(code->scratch);
+            code->scratch_sz = k * sz;
+            code->scratch = (gf *) my_malloc(code->scratch_sz * sizeof(gf), "decode scratch");
         }
+        for (j = 0; j < e->nmiss; j++)
+            code->scratch_pkt[j] = code->scratch + j * sz;
+        mul_rows(pkt, k, code->scratch_pkt, e->nmiss, e->rows, sz);
+        /*
+         * move pkts to their final destination
+         */
+        for (j = 0; j < e->nmiss; j++)
+            bcopy(code->scratch_pkt[j], pkt[e->miss[j]], sz * sizeof(gf));
     }
-    free(new_pkt);
-    free(m_dec);
+    pthread_mutex_unlock(&code->lock);
 
     return 0;
 }
+/*
+ * fec_xor() computes dst[] ^= src[] over sz bytes
+ */
+void
+fec_xor(void *dst, const void *src, int sz)
+{
+    if (fec_initialized == 0)
+        init_fec();
+    xor1((unsigned char *) dst, (const unsigned char *) src, sz);
+}
+
+/*
+ * fec_addmul() computes dst[] ^= c * src[] over sz bytes, GF_BITS 8 only
+ */
+void
+fec_addmul(void *dst, const void *src, int c, int sz)
+{
+    if (fec_initialized == 0)
+        init_fec();
+    if (c == 1)
+        xor1((unsigned char *) dst, (const unsigned char *) src, sz);
+    else
+        addmul((gf *) dst, (gf *) src, (gf) c, sz);
+}
+
 int get_n(void *code0) {
     struct fec_parms *code = (struct fec_parms *) code0;
     return code->n;
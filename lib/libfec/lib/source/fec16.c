@@ -0,0 +1,441 @@
+/*
+ * fec16.c
+ *
+ * Reed-Solomon erasure code over GF(2^16) with FFT based encoding and
+ * decoding, after "Novel Polynomial Basis and Its Application to
+ * Reed-Solomon Erasure Codes" (Lin, Chung, Han 2014) and the way
+ * Leopard-RS lays it out:
+ *
+ * - field elements are kept in the cantor basis, so the subspace
+ *   polynomials of the additive FFT have their skew factors in one table
+ * - the m parity shards are the FFT of the IFFTs of every chunk of m data
+ *   shards, m rounded up to a power of two
+ * - erasures are decoded with the error locator evaluated by two walsh
+ *   hadamard transforms, then an IFFT, the formal derivative and an FFT
+ *   over the k + m shards
+ */
+#include "fec16.h"
+#include "fec.h"
+#include "string.h"
+
+/*
+ * x86 builds carry SSSE3/AVX2 versions of mul_add(), compiled with per-function
+ * target attributes and picked at runtime in init_fec16(), as fec.c does
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 6))
+#define FEC16_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef unsigned short ffe_t;
+
+#define FEC16_BITS 16
+#define FEC16_ORDER 65536
+#define FEC16_MODULUS 65535
+#define FEC16_POLYNOMIAL 0x1002D
+
+static const ffe_t cantor_basis[FEC16_BITS] = {
+        0x0001, 0xACCA, 0x3C0E, 0x163E, 0xC582, 0xED2E, 0x914C, 0x4012,
+        0x6C98, 0x10D8, 0x6A72, 0xB900, 0xFDB8, 0xFB34, 0xFF38, 0x991E
+};
+
+static ffe_t log_lut[FEC16_ORDER];
+static ffe_t exp_lut[FEC16_ORDER];
+/* skew factors of the FFT layers, as logs, FEC16_MODULUS means 0 */
+static ffe_t fft_skew[FEC16_MODULUS];
+/* FWHT of the logs, used to evaluate the error locator */
+static ffe_t log_walsh[FEC16_ORDER];
+
+static int fec16_initialized = 0;
+
+/* a + b mod 65535, 65535 may be returned for 0 */
+static inline ffe_t
+add_mod(ffe_t a, ffe_t b) {
+    const unsigned sum = (unsigned) a + b;
+    return (ffe_t) (sum + (sum >> FEC16_BITS));
+}
+
+static inline ffe_t
+sub_mod(ffe_t a, ffe_t b) {
+    const unsigned dif = (unsigned) a - b;
+    return (ffe_t) (dif + (dif >> FEC16_BITS));
+}
+
+static inline ffe_t
+multiply_log(ffe_t a, ffe_t log_b) {
+    if (a == 0)
+        return 0;
+    return exp_lut[add_mod(log_lut[a], log_b)];
+}
+
+/*
+ * in place walsh hadamard transform mod 65535, groups starting at or above
+ * m_truncated are all zero and stay so
+ */
+static void
+fwht(ffe_t *data, unsigned m, unsigned m_truncated) {
+    for (unsigned dist = 1; dist < m; dist <<= 1) {
+        for (unsigned r = 0; r < m_truncated; r += dist << 1) {
+            for (unsigned i = r; i < r + dist; i++) {
+                const ffe_t sum = add_mod(data[i], data[i + dist]);
+                const ffe_t dif = sub_mod(data[i], data[i + dist]);
+                data[i] = sum;
+                data[i + dist] = dif;
+            }
+        }
+    }
+}
+
+static void
+init_tables() {
+    unsigned state = 1;
+    for (unsigned i = 0; i < FEC16_MODULUS; i++) {
+        exp_lut[state] = (ffe_t) i;
+        state <<= 1;
+        if (state >= FEC16_ORDER)
+            state ^= FEC16_POLYNOMIAL;
+    }
+    exp_lut[0] = FEC16_MODULUS;
+
+    /* conversion to the cantor basis */
+    log_lut[0] = 0;
+    for (unsigned i = 0; i < FEC16_BITS; i++) {
+        const unsigned width = 1u << i;
+        for (unsigned j = 0; j < width; j++)
+            log_lut[j + width] = log_lut[j] ^ cantor_basis[i];
+    }
+    for (unsigned i = 0; i < FEC16_ORDER; i++)
+        log_lut[i] = exp_lut[log_lut[i]];
+    for (unsigned i = 0; i < FEC16_ORDER; i++)
+        exp_lut[log_lut[i]] = (ffe_t) i;
+    exp_lut[FEC16_MODULUS] = exp_lut[0];
+
+    ffe_t temp[FEC16_BITS - 1];
+    for (unsigned i = 1; i < FEC16_BITS; i++)
+        temp[i - 1] = (ffe_t) (1u << i);
+    for (unsigned m = 0; m < FEC16_BITS - 1; m++) {
+        const unsigned step = 1u << (m + 1);
+        fft_skew[(1u << m) - 1] = 0;
+        for (unsigned i = m; i < FEC16_BITS - 1; i++) {
+            const unsigned s = 1u << (i + 1);
+            for (unsigned j = (1u << m) - 1; j < s; j += step)
+                fft_skew[j + s] = fft_skew[j] ^ temp[i];
+        }
+        temp[m] = FEC16_MODULUS - log_lut[multiply_log(temp[m], log_lut[temp[m] ^ 1])];
+        for (unsigned i = m + 1; i < FEC16_BITS - 1; i++)
+            temp[i] = multiply_log(temp[i], add_mod(log_lut[temp[i] ^ 1], temp[m]));
+    }
+    for (unsigned i = 0; i < FEC16_MODULUS; i++)
+        fft_skew[i] = log_lut[fft_skew[i]];
+
+    for (unsigned i = 0; i < FEC16_ORDER; i++)
+        log_walsh[i] = log_lut[i];
+    log_walsh[0] = 0;
+    fwht(log_walsh, FEC16_ORDER, FEC16_ORDER);
+}
+
+/*
+ * multiplying by a constant is linear over GF(2), so a symbol's product is
+ * the xor of the products of its 4 nibbles, lo[n][v] and hi[n][v] are the
+ * low and high byte of c * (v << 4n), which turns a vector of products into
+ * 8 pshufb lookups just like addmul1 of fec.c
+ */
+typedef struct {
+    unsigned char lo[4][16];
+    unsigned char hi[4][16];
+} nibble_tables;
+
+static void
+make_nibble_tables(nibble_tables *t, ffe_t log_m) {
+    for (int n = 0; n < 4; n++) {
+        for (int v = 0; v < 16; v++) {
+            const ffe_t prod = multiply_log((ffe_t) (v << (4 * n)), log_m);
+            t->lo[n][v] = (unsigned char) prod;
+            t->hi[n][v] = (unsigned char) (prod >> 8);
+        }
+    }
+}
+
+/*
+ * the shards hold little endian symbols at any alignment, fec headers in
+ * front of them are 11 or 12 bytes long
+ */
+static void
+mul_add_scalar(unsigned char *x, const unsigned char *y, const nibble_tables *t, int size) {
+    for (int i = 0; i < size; i += 2) {
+        const unsigned lo = y[i], hi = y[i + 1];
+        x[i] ^= t->lo[0][lo & 0x0f] ^ t->lo[1][lo >> 4] ^ t->lo[2][hi & 0x0f] ^ t->lo[3][hi >> 4];
+        x[i + 1] ^= t->hi[0][lo & 0x0f] ^ t->hi[1][lo >> 4] ^ t->hi[2][hi & 0x0f] ^ t->hi[3][hi >> 4];
+    }
+}
+
+typedef void (*mul_add_fn)(unsigned char *x, const unsigned char *y, const nibble_tables *t, int size);
+
+static mul_add_fn mul_add1 = mul_add_scalar;
+
+#ifdef FEC16_X86_SIMD
+/*
+ * 16 symbols per 32 bytes: split into their low and high bytes, look the
+ * 4 nibbles up and interleave the products back
+ */
+__attribute__((target("ssse3")))
+static void
+mul_add_ssse3(unsigned char *x, const unsigned char *y, const nibble_tables *t, int size) {
+    const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i tlo[4], thi[4];
+    for (int n = 0; n < 4; n++) {
+        tlo[n] = _mm_loadu_si128((const __m128i *) t->lo[n]);
+        thi[n] = _mm_loadu_si128((const __m128i *) t->hi[n]);
+    }
+    int i = 0;
+
+    for (; i + 32 <= size; i += 32) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (y + i)), split);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (y + i + 16)), split);
+        __m128i lo = _mm_unpacklo_epi64(a, b), hi = _mm_unpackhi_epi64(a, b);
+        __m128i n0 = _mm_and_si128(lo, mask), n1 = _mm_and_si128(_mm_srli_epi64(lo, 4), mask);
+        __m128i n2 = _mm_and_si128(hi, mask), n3 = _mm_and_si128(_mm_srli_epi64(hi, 4), mask);
+        __m128i plo = _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(tlo[0], n0), _mm_shuffle_epi8(tlo[1], n1)),
+                                    _mm_xor_si128(_mm_shuffle_epi8(tlo[2], n2), _mm_shuffle_epi8(tlo[3], n3)));
+        __m128i phi = _mm_xor_si128(_mm_xor_si128(_mm_shuffle_epi8(thi[0], n0), _mm_shuffle_epi8(thi[1], n1)),
+                                    _mm_xor_si128(_mm_shuffle_epi8(thi[2], n2), _mm_shuffle_epi8(thi[3], n3)));
+        __m128i d0 = _mm_loadu_si128((const __m128i *) (x + i));
+        __m128i d1 = _mm_loadu_si128((const __m128i *) (x + i + 16));
+        _mm_storeu_si128((__m128i *) (x + i), _mm_xor_si128(d0, _mm_unpacklo_epi8(plo, phi)));
+        _mm_storeu_si128((__m128i *) (x + i + 16), _mm_xor_si128(d1, _mm_unpackhi_epi8(plo, phi)));
+    }
+    if (i < size)
+        mul_add_scalar(x + i, y + i, t, size - i);
+}
+
+/* same as mul_add_ssse3 in both 128 bits lanes, symbols never cross a lane */
+__attribute__((target("avx2")))
+static void
+mul_add_avx2(unsigned char *x, const unsigned char *y, const nibble_tables *t, int size) {
+    const __m256i split = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+                                           0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    __m256i tlo[4], thi[4];
+    for (int n = 0; n < 4; n++) {
+        tlo[n] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) t->lo[n]));
+        thi[n] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) t->hi[n]));
+    }
+    int i = 0;
+
+    for (; i + 64 <= size; i += 64) {
+        __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (y + i)), split);
+        __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (y + i + 32)), split);
+        __m256i lo = _mm256_unpacklo_epi64(a, b), hi = _mm256_unpackhi_epi64(a, b);
+        __m256i n0 = _mm256_and_si256(lo, mask), n1 = _mm256_and_si256(_mm256_srli_epi64(lo, 4), mask);
+        __m256i n2 = _mm256_and_si256(hi, mask), n3 = _mm256_and_si256(_mm256_srli_epi64(hi, 4), mask);
+        __m256i plo = _mm256_xor_si256(
+                _mm256_xor_si256(_mm256_shuffle_epi8(tlo[0], n0), _mm256_shuffle_epi8(tlo[1], n1)),
+                _mm256_xor_si256(_mm256_shuffle_epi8(tlo[2], n2), _mm256_shuffle_epi8(tlo[3], n3)));
+        __m256i phi = _mm256_xor_si256(
+                _mm256_xor_si256(_mm256_shuffle_epi8(thi[0], n0), _mm256_shuffle_epi8(thi[1], n1)),
+                _mm256_xor_si256(_mm256_shuffle_epi8(thi[2], n2), _mm256_shuffle_epi8(thi[3], n3)));
+        __m256i d0 = _mm256_loadu_si256((const __m256i *) (x + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *) (x + i + 32));
+        _mm256_storeu_si256((__m256i *) (x + i), _mm256_xor_si256(d0, _mm256_unpacklo_epi8(plo, phi)));
+        _mm256_storeu_si256((__m256i *) (x + i + 32), _mm256_xor_si256(d1, _mm256_unpackhi_epi8(plo, phi)));
+    }
+    if (i < size)
+        mul_add_ssse3(x + i, y + i, t, size - i);
+}
+#endif /* FEC16_X86_SIMD */
+
+/* x[] ^= y[] * exp(log_m) */
+static void
+mul_add(char *x, const char *y, ffe_t log_m, int size) {
+    nibble_tables t;
+    make_nibble_tables(&t, log_m);
+    mul_add1((unsigned char *) x, (const unsigned char *) y, &t, size);
+}
+
+/* x[] = y[] * exp(log_m) */
+static void
+mul_mem(char *x, const char *y, ffe_t log_m, int size) {
+    memset(x, 0, size);
+    mul_add(x, y, log_m, size);
+}
+
+void
+init_fec16() {
+    init_tables();
+#ifdef FEC16_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        mul_add1 = mul_add_avx2;
+    else if (__builtin_cpu_supports("ssse3"))
+        mul_add1 = mul_add_ssse3;
+#endif
+    fec16_initialized = 1;
+}
+
+#define WORK(i) (work + (size_t) (i) * size)
+
+/*
+ * inverse FFT over m shards of work, decimation in time, shards at or
+ * above m_truncated are zero, the butterflies at r + dist use skew[r + dist - 1]
+ */
+static void
+ifft_dit(char *work, int size, unsigned m_truncated, unsigned m, const ffe_t *skew) {
+    for (unsigned dist = 1; dist < m; dist <<= 1) {
+        for (unsigned r = 0; r < m_truncated; r += dist << 1) {
+            const ffe_t log_m = skew[r + dist - 1];
+            for (unsigned i = r; i < r + dist; i++) {
+                fec_xor(WORK(i + dist), WORK(i), size);
+                if (log_m != FEC16_MODULUS)
+                    mul_add(WORK(i), WORK(i + dist), log_m, size);
+            }
+        }
+    }
+}
+
+/* FFT over m shards of work, only the first m_truncated outputs are needed */
+static void
+fft_dit(char *work, int size, unsigned m_truncated, unsigned m, const ffe_t *skew) {
+    for (unsigned dist = m >> 1; dist > 0; dist >>= 1) {
+        for (unsigned r = 0; r < m_truncated; r += dist << 1) {
+            const ffe_t log_m = skew[r + dist - 1];
+            for (unsigned i = r; i < r + dist; i++) {
+                if (log_m != FEC16_MODULUS)
+                    mul_add(WORK(i), WORK(i + dist), log_m, size);
+                fec_xor(WORK(i + dist), WORK(i), size);
+            }
+        }
+    }
+}
+
+static unsigned
+next_pow2(unsigned n) {
+    unsigned p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+static int
+check_args(int k, int m, int size) {
+    if (k <= 0 || m <= 0 || size <= 0 || (size & 1))
+        return -1;
+    if ((unsigned) k + next_pow2((unsigned) m) > FEC16_MAX_SHARDS)
+        return -1;
+    if (fec16_initialized == 0)
+        init_fec16();
+    return 0;
+}
+
+size_t
+fec16_encode_work_size(int k, int m, int size) {
+    (void) k;
+    return 2 * (size_t) next_pow2((unsigned) m) * size;
+}
+
+size_t
+fec16_decode_work_size(int k, int m, int size) {
+    const unsigned n = next_pow2(next_pow2((unsigned) m) + (unsigned) k);
+    return FEC16_ORDER * sizeof(ffe_t) + (size_t) n * size;
+}
+
+int
+fec16_encode(int k, int m, char *data[], int size, void *work_area) {
+    if (check_args(k, m, size) < 0)
+        return -1;
+    char *work = (char *) work_area;
+    const unsigned mm = next_pow2((unsigned) m);
+    /* work[0, mm) accumulates the IFFT of every chunk of mm data shards,
+     * work[mm, 2mm) holds the chunk being transformed */
+    for (unsigned first = 0; first < (unsigned) k; first += mm) {
+        char *chunk = first == 0 ? work : WORK(mm);
+        const unsigned count = (unsigned) k - first < mm ? (unsigned) k - first : mm;
+        for (unsigned i = 0; i < count; i++)
+            memcpy(chunk + (size_t) i * size, data[first + i], size);
+        memset(chunk + (size_t) count * size, 0, (size_t) (mm - count) * size);
+        ifft_dit(chunk, size, count, mm, fft_skew + mm + first);
+        if (first != 0) {
+            for (unsigned i = 0; i < mm; i++)
+                fec_xor(WORK(i), WORK(mm + i), size);
+        }
+    }
+    fft_dit(work, size, (unsigned) m, mm, fft_skew);
+    for (int i = 0; i < m; i++)
+        memcpy(data[k + i], WORK(i), size);
+    return 0;
+}
+
+int
+fec16_decode(int k, int m, char *data[], int size, void *work_area) {
+    if (check_args(k, m, size) < 0)
+        return -1;
+    int count = 0, missing = 0;
+    for (int i = 0; i < k + m; i++) {
+        if (data[i] != 0)
+            count++;
+        else if (i < k)
+            missing++;
+    }
+    if (count < k)
+        return -1;
+    if (missing == 0)
+        return 0;
+    const unsigned mm = next_pow2((unsigned) m);
+    const unsigned n = next_pow2(mm + (unsigned) k);
+    ffe_t *error_locations = (ffe_t *) work_area;
+    char *work = (char *) work_area + FEC16_ORDER * sizeof(ffe_t);
+    char **recovery = data + k;
+
+    /* positions in work: redundant shards at [0, mm), original ones at [mm, mm + k) */
+    memset(error_locations, 0, FEC16_ORDER * sizeof(ffe_t));
+    for (unsigned i = 0; i < mm; i++)
+        if (i >= (unsigned) m || recovery[i] == 0)
+            error_locations[i] = 1;
+    for (int i = 0; i < k; i++)
+        if (data[i] == 0)
+            error_locations[mm + i] = 1;
+
+    /* evaluate the error locator polynomial */
+    fwht(error_locations, FEC16_ORDER, mm + (unsigned) k);
+    for (unsigned i = 0; i < FEC16_ORDER; i++)
+        error_locations[i] = (ffe_t) (((unsigned) error_locations[i] * log_walsh[i]) % FEC16_MODULUS);
+    fwht(error_locations, FEC16_ORDER, FEC16_ORDER);
+
+    for (unsigned i = 0; i < mm; i++) {
+        if (i < (unsigned) m && recovery[i] != 0)
+            mul_mem(WORK(i), recovery[i], error_locations[i], size);
+        else
+            memset(WORK(i), 0, size);
+    }
+    for (int i = 0; i < k; i++) {
+        if (data[i] != 0)
+            mul_mem(WORK(mm + i), data[i], error_locations[mm + i], size);
+        else
+            memset(WORK(mm + i), 0, size);
+    }
+    memset(WORK(mm + k), 0, (size_t) (n - mm - k) * size);
+
+    ifft_dit(work, size, mm + (unsigned) k, n, fft_skew);
+    /* formal derivative */
+    for (unsigned i = 1; i < n; i++) {
+        const unsigned width = ((i ^ (i - 1)) + 1) >> 1;
+        for (unsigned j = 0; j < width; j++)
+            fec_xor(WORK(i - width + j), WORK(i + j), size);
+    }
+    fft_dit(work, size, mm + (unsigned) k, n, fft_skew);
+
+    /* reveal the erasures into the memory of the redundant shards, which are
+     * no longer needed */
+    int spare = 0;
+    for (int i = 0; i < k; i++) {
+        if (data[i] != 0)
+            continue;
+        while (recovery[spare] == 0)
+            spare++;
+        mul_mem(recovery[spare], WORK(mm + i), FEC16_MODULUS - error_locations[mm + i], size);
+        data[i] = recovery[spare];
+        recovery[spare] = 0;
+    }
+    return 0;
+}
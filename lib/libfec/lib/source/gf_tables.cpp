@@ -0,0 +1,36 @@
+/*
+ * gf_tables.cpp
+ *
+ * The GF(2^8) tables are a constant expression, so they are emitted as
+ * initialized read-only data and never computed at run time.
+ */
+#include "gf_tables.h"
+
+namespace {
+
+constexpr struct fec_gf_tables MakeTables() {
+    struct fec_gf_tables t{};
+    for (int i = 0; i < 2 * 255; i++)
+        t.exp[i] = fec_gf::kExpLog.exp[i];
+    for (int i = 0; i < 256; i++) {
+        t.log[i] = fec_gf::kExpLog.log[i];
+        t.inverse[i] = fec_gf::Inverse(i);
+    }
+    for (int i = 0; i < 256; i++)
+        for (int j = 0; j < 256; j++)
+            t.mul[i][j] = fec_gf::Mul(i, j);
+    for (int c = 0; c < 256; c++)
+        for (int i = 0; i < 16; i++) {
+            t.mul_nibble[c][0][i] = t.mul[c][i];
+            t.mul_nibble[c][1][i] = t.mul[c][i << 4];
+        }
+    return t;
+}
+
+constexpr struct fec_gf_tables kTables = MakeTables();
+
+}
+
+extern "C" {
+alignas(64) extern const struct fec_gf_tables fec_gf_tables = kTables;
+}
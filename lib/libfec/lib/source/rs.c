@@ -11,11 +11,7 @@
 void rs_encode(void *code,char *data[],int size)
 {
 	int k=get_k(code);
-	int n=get_n(code);
-	for(int i=k;i<n;i++)
-	{
-		fec_encode(code, (void **)data, data[i],i, size);
-	}
+	fec_encode_parity(code, (void **)data, (void **)(data+k), size);
 
 	return ;
 }
@@ -45,18 +41,10 @@ int rs_decode(void *code,char *data[],int size)
 	return fec_decode(code,(void**)data,index,size);
 }
 
-static void * (*table)[256]=0;
+// zero filled bss, the pages are only touched for the (k,n) in use
+static void *table[256][256];
 void* get_code(int k,int n)
 {
-	if (table==0)
-	{
-		table=(void* (*)[256]) malloc(sizeof(void*)*256*256);
-		if(!table)
-		{
-		    return table;
-		}
-		memset(table,0,sizeof(void*)*256*256);
-	}
 	if(table[k][n]==0)
 	{
 		table[k][n]=fec_new(k,n);
@@ -74,3 +62,38 @@ int rs_decode2(int k,int n,char *data[],int size)
 	void* code=get_code(k,n);
 	return rs_decode(code,data,size);
 }
+
+void xor_encode(int k,char *data[],int size)
+{
+	memcpy(data[k],data[0],size);
+	for(int i=1;i<k;i++)
+	{
+		fec_xor(data[k],data[i],size);
+	}
+}
+
+int xor_decode(int k,char *data[],int size)
+{
+	int missing=-1;
+	for(int i=0;i<k;i++)
+	{
+		if(data[i]==0)
+		{
+			if(missing>=0)
+				return -1;
+			missing=i;
+		}
+	}
+	if(missing<0)
+		return 0;
+	if(data[k]==0)
+		return -1;
+	for(int i=0;i<k;i++)
+	{
+		if(i!=missing)
+			fec_xor(data[k],data[i],size);
+	}
+	data[missing]=data[k];
+	data[k]=0;
+	return 0;
+}
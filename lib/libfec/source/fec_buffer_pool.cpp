@@ -0,0 +1,33 @@
+//
+// Created by lwj on 2020/3/21.
+//
+
+#include "fec_buffer_pool.h"
+#include <cstddef>
+
+FecBufferPool::FecBufferPool(const int32_t &buffer_size)
+    : buffer_size_(buffer_size),
+      stride_((buffer_size + kFecBufferSlack + 63) & ~63) {}
+
+char *FecBufferPool::Acquire() {
+    if (free_.empty())
+        Grow();
+    char *buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+}
+
+void FecBufferPool::Release(char *buffer) {
+    if (buffer != nullptr)
+        free_.push_back(buffer);
+}
+
+void FecBufferPool::Grow() {
+    ///the chunk's data never moves, only the vector of chunks does
+    chunks_.emplace_back(static_cast<size_t>(stride_) * kFecBuffersPerChunk + 63);
+    auto base = reinterpret_cast<uintptr_t>(chunks_.back().data());
+    char *first = chunks_.back().data() + ((64 - base % 64) % 64);
+    free_.reserve(chunks_.size() * kFecBuffersPerChunk);
+    for (int32_t i = kFecBuffersPerChunk - 1; i >= 0; --i)
+        free_.push_back(first + static_cast<size_t>(i) * stride_);
+}
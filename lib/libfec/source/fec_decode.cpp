@@ -6,214 +6,598 @@
 #include <algorithm>
 #include <cstring>
 #include "rs.h"
+#include "fec16.h"
 
-int32_t FecDecodeOutputDataUnit::LargerMem(uint32_t expected_len) {
-    if (expected_len < max_len)
-        return 0;
-    free(data);
-    data = (char *) malloc(expected_len + 1);
-    if (data == nullptr)
-        return -1;
-    bzero(data, expected_len + 1);
-    max_len = expected_len;
-    return 0;
+namespace {
+
+///signed distance a - b in the wrapping seq space, seq 0 sits where kFecSeqMax does
+int32_t SeqDiff(const uint16_t &a, const uint16_t &b) {
+    int32_t d = static_cast<int32_t>(a % kFecSeqMax) - static_cast<int32_t>(b % kFecSeqMax);
+    if (d > kFecSeqMax / 2)
+        d -= kFecSeqMax;
+    else if (d < -kFecSeqMax / 2)
+        d += kFecSeqMax;
+    return d;
+}
+
+uint16_t NextSeq(const uint16_t &seq) {
+    return seq >= kFecSeqMax ? 1 : seq + 1;
+}
+
+}
+
+template<typename Lock>
+FecDecodeT<Lock>::FecDecodeT(const int32_t &timeout_ms, const int32_t &buffer_size)
+    : groups_(kFecDecodeWindow, FecDecodeGroup()),
+      output_queue_(kFecDecodeOutputQueueSize),
+      output_head_(0),
+      output_count_(0),
+      timeout_ms_(timeout_ms),
+      timeout_wheel_(getnowtime_ms()),
+      ready_seqs_nums_(0),
+      loss_started_(false),
+      settled_seq_(0),
+      loss_received_(0),
+      loss_expected_(0),
+      last_feedback_ms_(0),
+      window_loss_started_(false),
+      window_loss_esi_(0),
+      window_ready_length_(0),
+      raw_queue_(kFecDecodeRawQueueSize),
+      raw_head_(0),
+      raw_count_(0),
+      pool_(buffer_size),
+      views_out_(false) {}
+
+///every buffer belongs to pool_, nothing to free one by one
+template<typename Lock>
+FecDecodeT<Lock>::~FecDecodeT() = default;
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::Input(const char *input_data_pkg, int32_t length) {
+    return InputPkg(input_data_pkg, length, nullptr);
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::InputBuffer(char *&buffer, int32_t length) {
+    return InputPkg(buffer, length, &buffer);
+}
+
+template<typename Lock>
+char *FecDecodeT<Lock>::AcquireBuffer() {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    return pool_.Acquire();
 }
 
-FecDecode::FecDecode(const int32_t &timeout_ms) : Sptr2TimeoutMap_(new TimeOutMap(timeout_ms)),
-                                                  ready_seqs_nums_(0) {
-    output_unit_.data = nullptr;
-    output_unit_.max_len = 0;
-    output_unit_.actural_len = 0;
-    output_unit_.last_process_seq = -1;
-    output_unit_.last_process_index = -1;
-    output_unit_.ready_for_output = false;
+template<typename Lock>
+void FecDecodeT<Lock>::ReleaseBuffer(char *buffer) {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    pool_.Release(buffer);
 }
 
-FecDecode::~FecDecode() {
-    output_unit_.actural_len = 0;
-    output_unit_.max_len = 0;
-    free(output_unit_.data);
-};
+template<typename Lock>
+int32_t FecDecodeT<Lock>::BufferSize() const {
+    return pool_.buffer_size();
+}
 
-int32_t FecDecode::Input(const char *input_data_pkg, int32_t length) {
+template<typename Lock>
+int32_t FecDecodeT<Lock>::InputPkg(const char *input_data_pkg, int32_t length, char **buffer) {
     if (length < sizeof(unique_header_) || input_data_pkg == nullptr)
         return -1;
-    uint32_t unique_header = read_u32(input_data_pkg);
-    if (unique_header != unique_header_)
-        return DealUnEncodeData(input_data_pkg, length);
-    if(length < fec_encode_head_length_)
+    ///whatever is kept has to fit in a pool buffer
+    if (length > pool_.buffer_size())
         return -1;
-    uint16_t seq = read_u16(input_data_pkg + 4);
-    uint16_t package_length = read_u16(input_data_pkg + 6);
-    auto data_pkg_num = static_cast<int32_t>(input_data_pkg[8]);
-    auto redundant_pkg_num = static_cast<int32_t>(input_data_pkg[9]);
-    auto index = static_cast<int32_t>(input_data_pkg[10]);
-    if (index == 0 || index > (data_pkg_num + redundant_pkg_num))
+    FecFeedback feedback;
+    auto feedback_length = ParseFecFeedback(input_data_pkg, length, feedback);
+    if (feedback_length != 0) {
+        if (feedback_length > 0 && feedback_handler_)
+            feedback_handler_(feedback);
+        return feedback_length > 0 ? 0 : -1;
+    }
+    FecWindowHeader window_header;
+    auto window_header_length = ParseFecWindowHeader(input_data_pkg, length, window_header);
+    if (window_header_length != 0) {
+        if (window_header_length < 0)
+            return -1;
+        std::lock_guard<Lock> lck(seq_mutex_);
+        if (window_decoder_.Input(input_data_pkg, length) < 0)
+            return -1;
+        if (window_header.window == 0)
+            CountWindowSource(window_header.esi);
+        return PendingLength();
+    }
+    FecHeader header;
+    auto header_length = ParseFecHeader(input_data_pkg, length, header);
+    if (header_length == 0) {
+        std::lock_guard<Lock> lck(seq_mutex_);
+        return DealUnEncodeDataLocked(input_data_pkg, length, buffer);
+    }
+    if (header_length < 0)
+        return -1;
+    ///a corrupted shard is no better than a lost one, fec rebuilds it from the others
+    if (!VerifyFecHeader(input_data_pkg, length))
         return -1;
+    uint16_t seq = header.seq;
+    auto data_pkg_num = static_cast<int32_t>(header.data_pkg_num);
+    auto redundant_pkg_num = static_cast<int32_t>(header.redundant_pkg_num);
     ///由于索引是从1开始的,所以这里需要做一个减法操作
-    index--;
-    length -= fec_encode_head_length_;
-    ///下面这种情况说明实际上对应seq的所有数据已经解码完成同时已经被输出过了,所以直接返回0就好
-    if (seq2data_pkgs_.count(seq))
-        if (!seq2ready_for_output_[seq] && seq2cur_recv_data_pkg_num_[seq] >= seq2data_pkgs_num_[seq])
-            return 0;
-    if (seq2ready_for_output_[seq])
-        return 1;
-    char *data = (char *) malloc((length + 1));
-    bzero(data, (length + 1));
-    memcpy(data, input_data_pkg + fec_encode_head_length_, length + 1);
-    std::lock_guard<std::mutex> lck(seq_mutex_);
-    seq2data_pkgs_num_[seq] = data_pkg_num;
-    seq2redundant_data_pkgs_num_[seq] = redundant_pkg_num;
-    seq2max_data_pkg_length_[seq] = std::max(seq2max_data_pkg_length_[seq], length);
-    Sptr2TimeoutMap_->Add(seq, getnowtime_ms());
-    if (seq2data_pkgs_[seq].empty()) {
-        seq2data_pkgs_[seq].resize(data_pkg_num + redundant_pkg_num);
-        seq2data_pkgs_length_[seq].resize(data_pkg_num + redundant_pkg_num);
+    auto index = static_cast<int32_t>(header.index) - 1;
+    length -= header_length;
+    if (seq > kFecSeqMax || data_pkg_num == 0 || data_pkg_num + redundant_pkg_num > kFecDecodeMaxShards ||
+        index < 0 || index >= data_pkg_num + redundant_pkg_num || header.length > length)
+        return -1;
+    std::lock_guard<Lock> lck(seq_mutex_);
+    FecDecodeGroup *group = AcquireGroup(seq);
+    if (group == nullptr)
+        return 0;
+    ///the group has already been decoded or given up on, nothing new for the caller
+    if (group->state == kFecGroupReady || group->state == kFecGroupDraining || group->state == kFecGroupDone) {
+        group->seen_bitmap.set(index);
+        return 0;
     }
+    if (group->state == kFecGroupFree) {
+        SettleGroups(seq, data_pkg_num + redundant_pkg_num);
+        group->state = kFecGroupFilling;
+        group->seq = seq;
+        group->flags = header.flags;
+        group->data_pkg_num = header.data_pkg_num;
+        group->redundant_pkg_num = header.redundant_pkg_num;
+        group->recv_num = 0;
+        group->max_length = 0;
+        group->head_length = static_cast<uint8_t>(header_length);
+        group->recv_bitmap.reset();
+        group->output_bitmap.reset();
+        group->pending_bitmap.reset();
+        group->seen_bitmap.reset();
+        group->timer.data = seq % kFecDecodeWindow;
+    } else if (group->redundant_pkg_num != header.redundant_pkg_num || group->flags != header.flags) {
+        return -1;
+    } else if (group->data_pkg_num != header.data_pkg_num && ReshapeGroup(*group, header, index) < 0) {
+        return -1;
+    }
+    ///a short group only has k' data shards, whatever its data shards said
+    data_pkg_num = group->data_pkg_num;
     ///防止有重复的包出现
-    if (seq2data_pkgs_[seq][index] == nullptr)
-        seq2data_pkgs_[seq][index] = data;
-    else {
-        ///这里直接释放数据然后返回就好
-        free(data);
+    if (group->recv_bitmap.test(index))
         return 0;
+    group->seen_bitmap.set(index);
+    ///the shard stays in the buffer it was received into, behind its header
+    char *shard_buffer;
+    if (buffer != nullptr && header_length == group->head_length) {
+        shard_buffer = *buffer;
+        *buffer = pool_.Acquire();
+    } else {
+        shard_buffer = pool_.Acquire();
+        memcpy(shard_buffer + group->head_length, input_data_pkg + header_length, length);
     }
-    seq2data_pkgs_length_[seq][index] = package_length;
-    ++seq2cur_recv_data_pkg_num_[seq];
-    if (seq2cur_recv_data_pkg_num_[seq] >= seq2data_pkgs_num_[seq]) {
+    group->shards[index] = shard_buffer + group->head_length;
+    group->lengths[index] = index < data_pkg_num ? header.length : static_cast<uint16_t>(length);
+    group->recv_bitmap.set(index);
+    group->max_length = std::max(group->max_length, length);
+    ++group->recv_num;
+    ///the code is systematic, a data shard is the original package and goes out right away
+    if (index < data_pkg_num)
+        QueueOutput(*group, index);
+    if (group->recv_num >= data_pkg_num) {
         ///说明可以进行解码操作了
-        char **wait_decode_data = nullptr;
-        wait_decode_data = (char **) malloc((data_pkg_num +
-            redundant_pkg_num) * sizeof(char *));
-        for (int32_t i = 0; i < data_pkg_num + redundant_pkg_num; ++i) {
-            wait_decode_data[i] = seq2data_pkgs_[seq][i];
+        timeout_wheel_.Cancel(&group->timer);
+        group->state = kFecGroupReady;
+        if (DecodeGroup(*group) < 0) {
+            ///the data shards that did arrive are still handed out
+            AbandonGroup(*group);
+            auto next_length = NextOutputLength();
+            return next_length > 0 ? next_length : -1;
         }
-        int32_t ret = rs_decode2(data_pkg_num, data_pkg_num + redundant_pkg_num, wait_decode_data,
-                                 seq2max_data_pkg_length_[seq]);
-        if (ret < 0)
-            return -1;
-        for (int32_t i = 0; i < data_pkg_num + redundant_pkg_num; ++i) {
-            seq2data_pkgs_[seq][i] = wait_decode_data[i];
-            if (seq2data_pkgs_length_[seq][i] == 0)
-                seq2data_pkgs_length_[seq][i] = seq2max_data_pkg_length_[seq];
+        for (int32_t i = 0; i < data_pkg_num; ++i) {
+            if (!group->output_bitmap.test(i))
+                QueueOutput(*group, i);
         }
-        seq2data_pkgs_[seq].erase(std::begin(seq2data_pkgs_[seq]) + data_pkg_num,
-                                  std::end(seq2data_pkgs_[seq]));
-        seq2data_pkgs_length_[seq].erase(std::begin(seq2data_pkgs_length_[seq]) + data_pkg_num,
-                                         std::end(seq2data_pkgs_length_[seq]));
-        ///解码完成
-        free(wait_decode_data);
-        seq2ready_for_output_[seq] = true;
-        ready_seqs_nums_++;
-        return seq2max_data_pkg_length_[seq];
-    }
-    if (seq2data_pkgs_.size() > 50)
-        ClearTimeoutDatas();
+        ///everything had already been output before the group completed
+        if (group->pending_bitmap.none()) {
+            ReleaseGroup(*group);
+            group->state = kFecGroupDone;
+        }
+    } else {
+        timeout_wheel_.Schedule(&group->timer, static_cast<uint64_t>(timeout_ms_));
+    }
+    return PendingLength();
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::ReshapeGroup(FecDecodeGroup &group, const FecHeader &header, const int32_t &index) {
+    const int32_t k = group.data_pkg_num;
+    ///a data shard of a group whose short parity came first, it is one of the k'
+    if (header.data_pkg_num > k)
+        return index < k ? 0 : -1;
+    ///the parity of a group the encoder closed after k' data shards, nothing received
+    ///may sit at k' or above, full parity would have been at k and above
+    const int32_t short_k = header.data_pkg_num;
+    if (index < short_k)
+        return -1;
+    if ((group.recv_bitmap >> short_k).any())
+        return -1;
+    ///the parity then lands at k' and above, right behind the data shards
+    group.data_pkg_num = static_cast<uint8_t>(short_k);
     return 0;
 }
 
-int32_t FecDecode::DealUnEncodeData(const char *input_data_pkg, int32_t length) {
-    if (input_data_pkg == nullptr || read_u32_r(input_data_pkg) != unique_header_)
-        return -2;
-    std::lock_guard<std::mutex> lck(output_unit_mutex_);
-    auto ret = output_unit_.LargerMem(length);
+template<typename Lock>
+FecDecodeGroup *FecDecodeT<Lock>::AcquireGroup(const uint16_t &seq) {
+    FecDecodeGroup &group = groups_[seq % kFecDecodeWindow];
+    if (group.state == kFecGroupFree || group.seq == seq)
+        return &group;
+    if (SeqDiff(seq, group.seq) < 0)
+        return nullptr;
+    ReleaseGroup(group);
+    return &group;
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::DecodeGroup(FecDecodeGroup &group) {
+    const int32_t k = group.data_pkg_num, n = group.data_pkg_num + group.redundant_pkg_num;
+    ///every data shard arrived, there is nothing to rebuild
+    if ((group.recv_bitmap << (kFecDecodeMaxShards - k)).count() == static_cast<size_t>(k))
+        return 0;
+    ///wait_decode_data only reorders the buffers, so output the rebuilt shards from their slots
+    ///the codecs read max_length bytes of every shard, shorter ones are zero padded in place,
+    ///to an even length for the 16 bits symbols of the gf16 code, the pool leaves room for it
+    const int32_t shard_length = (group.flags & kFecFlagGf16) ? (group.max_length + 1) & ~1 : group.max_length;
+    char *wait_decode_data[kFecDecodeMaxShards];
+    for (int32_t i = 0; i < n; ++i) {
+        wait_decode_data[i] = nullptr;
+        if (!group.recv_bitmap.test(i))
+            continue;
+        bzero(group.shards[i] + group.lengths[i], shard_length - group.lengths[i]);
+        wait_decode_data[i] = group.shards[i];
+    }
+    int32_t ret = 0;
+    if (group.flags & kFecFlagXor) {
+        ret = xor_decode(k, wait_decode_data, group.max_length);
+    } else if (group.flags & kFecFlagGf16) {
+        const size_t work_size = fec16_decode_work_size(k, n - k, shard_length);
+        if (fec16_work_.size() < work_size)
+            fec16_work_.resize(work_size);
+        ret = fec16_decode(k, n - k, wait_decode_data, shard_length, fec16_work_.data());
+    } else {
+        ret = rs_decode2(k, n, wait_decode_data, group.max_length);
+    }
     if (ret < 0)
-        return ret;
-    memcpy(output_unit_.data, input_data_pkg + 4, length - 4);
-    output_unit_.actural_len = length - 4;
-    output_unit_.ready_for_output = true;
-    return output_unit_.actural_len;
-}
-
-int32_t FecDecode::Output(char *recv_buf, int32_t length) {
-    {
-        std::lock_guard<std::mutex> lck(output_unit_mutex_);
-        if (output_unit_.ready_for_output) {
-            if (recv_buf == nullptr || length < output_unit_.actural_len)
-                return -2;
-            memcpy(recv_buf, output_unit_.data, output_unit_.actural_len);
-            output_unit_.actural_len = 0;
-            output_unit_.ready_for_output = false;
-            auto ret = SearchForNextReadySeq(INT32_MAX);
-            if(ret <= 0)
-                return ret;
-            output_unit_.last_process_seq = ret;
-            output_unit_.last_process_index = 0;
-            return seq2data_pkgs_length_[ret][0];
+        return -1;
+    ///the shard buffers were only reordered, rebuilt data shards have the group max length
+    for (int32_t i = 0; i < n; ++i) {
+        group.shards[i] = wait_decode_data[i];
+        if (i < k && !group.recv_bitmap.test(i))
+            group.lengths[i] = static_cast<uint16_t>(group.max_length);
+    }
+    group.recv_bitmap.set();
+    return 0;
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::ReleaseGroup(FecDecodeGroup &group) {
+    if (group.state == kFecGroupFilling)
+        timeout_wheel_.Cancel(&group.timer);
+    if (group.state == kFecGroupFilling || group.state == kFecGroupReady || group.state == kFecGroupDraining) {
+        for (int32_t i = 0; i < group.data_pkg_num + group.redundant_pkg_num; ++i) {
+            ///xor_decode moves the parity into the lost slot and leaves its own empty
+            if (group.shards[i] != nullptr)
+                Recycle(group.shards[i] - group.head_length);
+            group.shards[i] = nullptr;
         }
     }
-    if (ready_seqs_nums_ == 0) {
-        ClearTimeoutDatas();
-        return -1;
+    group.recv_bitmap.reset();
+    group.output_bitmap.reset();
+    group.pending_bitmap.reset();
+    group.state = kFecGroupFree;
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::AbandonGroup(FecDecodeGroup &group) {
+    if (group.pending_bitmap.none()) {
+        ReleaseGroup(group);
+        group.state = kFecGroupDone;
+        return;
     }
-    {
-        std::lock_guard<std::mutex> lck1(((&seq_mutex_) < (&output_unit_mutex_)) ? seq_mutex_ : output_unit_mutex_);
-        std::lock_guard<std::mutex> lck2(((&seq_mutex_) < (&output_unit_mutex_)) ? output_unit_mutex_ : seq_mutex_);
-        if (output_unit_.last_process_seq != -1 && seq2ready_for_output_[output_unit_.last_process_seq]) {
-            bzero(recv_buf, length);
-            memcpy(recv_buf, seq2data_pkgs_[output_unit_.last_process_seq][output_unit_.last_process_index],
-                   seq2data_pkgs_length_[output_unit_.last_process_seq][output_unit_.last_process_index]);
-            ++output_unit_.last_process_index;
-            if (output_unit_.last_process_index == seq2data_pkgs_[output_unit_.last_process_seq].size()) {
-                seq2ready_for_output_[output_unit_.last_process_seq] = false;
-                --ready_seqs_nums_;
-                auto ret = SearchForNextReadySeq(INT32_MAX);
-                if (ret <= 0)
-                    return ret;
-                output_unit_.last_process_seq = ret;
-                output_unit_.last_process_index = 0;
-                return seq2data_pkgs_length_[ret][0];
-            } else
-                return seq2data_pkgs_length_[output_unit_.last_process_seq][output_unit_.last_process_index];
+    if (group.state == kFecGroupFilling)
+        timeout_wheel_.Cancel(&group.timer);
+    ///parity and the data shards already output are of no use any more
+    for (int32_t i = 0; i < group.data_pkg_num + group.redundant_pkg_num; ++i) {
+        if (!group.pending_bitmap.test(i) && group.shards[i] != nullptr) {
+            Recycle(group.shards[i] - group.head_length);
+            group.shards[i] = nullptr;
         }
-        auto ret = SearchForNextReadySeq(length);
-        if (ret <= 0)
-            return ret;
-        output_unit_.last_process_seq = ret;
-        output_unit_.last_process_index = 0;
     }
-    return Output(recv_buf, length);
+    group.recv_bitmap = group.pending_bitmap;
+    group.state = kFecGroupDraining;
 }
 
-int32_t FecDecode::SearchForNextReadySeq(const int32_t &least_len) {
-    if (ready_seqs_nums_ == 0) {
-        ClearTimeoutDatas();
-        return 0;
+template<typename Lock>
+void FecDecodeT<Lock>::QueueOutput(FecDecodeGroup &group, const int32_t &index) {
+    ///the caller stopped calling Output, drop the oldest queued data shard
+    if (output_count_ == kFecDecodeOutputQueueSize)
+        PopOutput();
+    output_queue_[(output_head_ + output_count_) % kFecDecodeOutputQueueSize] = {group.seq,
+                                                                                 static_cast<uint8_t>(index)};
+    ++output_count_;
+    UpdateReadyNum();
+    group.output_bitmap.set(index);
+    group.pending_bitmap.set(index);
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::PopOutput() {
+    const FecDecodeOutputEntry &entry = output_queue_[output_head_];
+    FecDecodeGroup &group = groups_[entry.seq % kFecDecodeWindow];
+    output_head_ = (output_head_ + 1) % kFecDecodeOutputQueueSize;
+    --output_count_;
+    UpdateReadyNum();
+    if (group.seq != entry.seq || (group.state != kFecGroupFilling && group.state != kFecGroupReady &&
+        group.state != kFecGroupDraining))
+        return;
+    group.pending_bitmap.reset(entry.index);
+    ///a decoded or abandoned group is done once its last queued data shard has been output
+    if (group.pending_bitmap.none() && group.state != kFecGroupFilling) {
+        ReleaseGroup(group);
+        group.state = kFecGroupDone;
     }
-    for (auto iter = seq2ready_for_output_.begin(); iter != seq2ready_for_output_.end(); ++iter) {
-        if (iter->second && seq2max_data_pkg_length_[iter->first] <= least_len)
-            return iter->first;
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::NextOutputLength() {
+    ///skip the shards whose group was evicted or timed out before they were output
+    while (output_count_ > 0) {
+        const FecDecodeOutputEntry &entry = output_queue_[output_head_];
+        const FecDecodeGroup &group = groups_[entry.seq % kFecDecodeWindow];
+        if (group.seq == entry.seq && (group.state == kFecGroupFilling || group.state == kFecGroupReady ||
+            group.state == kFecGroupDraining) && group.shards[entry.index] != nullptr)
+            return group.lengths[entry.index];
+        output_head_ = (output_head_ + 1) % kFecDecodeOutputQueueSize;
+        --output_count_;
+        UpdateReadyNum();
     }
     return 0;
 }
 
-void FecDecode::ClearTimeoutDatas() {
-    auto timeout_seqs = Sptr2TimeoutMap_->GetTimeOutElements(getnowtime_ms());
-    for (const auto &timeout_seq : timeout_seqs) {
-        if (!seq2ready_for_output_[timeout_seq])
-            RemoveSeqRespondData(timeout_seq);
+template<typename Lock>
+int32_t FecDecodeT<Lock>::DealUnEncodeData(const char *input_data_pkg, int32_t length) {
+    if (length > pool_.buffer_size())
+        return -2;
+    std::lock_guard<Lock> lck(seq_mutex_);
+    return DealUnEncodeDataLocked(input_data_pkg, length, nullptr);
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::DealUnEncodeDataLocked(const char *input_data_pkg, int32_t length, char **buffer) {
+    if (input_data_pkg == nullptr || length < 4 || read_u32_r(input_data_pkg) != unique_header_)
+        return -2;
+    ///nothing to hand to kcp
+    if (length == 4)
+        return PendingLength();
+    ///the caller stopped calling Output, drop the oldest unencoded package
+    if (raw_count_ == kFecDecodeRawQueueSize)
+        PopRaw();
+    char *raw_buffer;
+    if (buffer != nullptr) {
+        raw_buffer = *buffer;
+        *buffer = pool_.Acquire();
+    } else {
+        raw_buffer = pool_.Acquire();
+        memcpy(raw_buffer, input_data_pkg, length);
+    }
+    raw_queue_[(raw_head_ + raw_count_) % kFecDecodeRawQueueSize] = {raw_buffer, length - 4};
+    ++raw_count_;
+    UpdateReadyNum();
+    return PendingLength();
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::PopRaw() {
+    Recycle(raw_queue_[raw_head_].buffer);
+    raw_head_ = (raw_head_ + 1) % kFecDecodeRawQueueSize;
+    --raw_count_;
+    UpdateReadyNum();
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::Recycle(char *buffer) {
+    if (views_out_)
+        held_buffers_.push_back(buffer);
+    else
+        pool_.Release(buffer);
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::UpdateReadyNum() {
+    ready_seqs_nums_ = output_count_ + raw_count_;
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::Output(char *recv_buf, int32_t length) {
+    if (ready_seqs_nums_ == 0 && window_ready_length_ == 0) {
+        ClearTimeoutDatas();
+        return -1;
+    }
+    std::lock_guard<Lock> lck(seq_mutex_);
+    if (raw_count_ > 0) {
+        const FecDecodeRawEntry &entry = raw_queue_[raw_head_];
+        if (recv_buf == nullptr || length < entry.length)
+            return -2;
+        memcpy(recv_buf, entry.buffer + 4, entry.length);
+        PopRaw();
+        return PendingLength();
+    }
+    if (window_ready_length_ > 0) {
+        if (window_decoder_.Output(recv_buf, length) < 0)
+            return -2;
+        return PendingLength();
+    }
+    if (NextOutputLength() == 0) {
+        ClearTimeoutDatasLocked(getnowtime_ms());
+        return -1;
+    }
+    const FecDecodeOutputEntry &entry = output_queue_[output_head_];
+    const FecDecodeGroup &group = groups_[entry.seq % kFecDecodeWindow];
+    const int32_t data_length = group.lengths[entry.index];
+    if (recv_buf == nullptr || length < data_length)
+        return -2;
+    memcpy(recv_buf, group.shards[entry.index], data_length);
+    PopOutput();
+    return PendingLength();
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::OutputView(const char *&data) {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    return NextView(data);
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::Drain(const std::function<void(const char *data, int32_t length)> &handler) {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    int32_t drained = 0;
+    const char *data = nullptr;
+    int32_t length;
+    while ((length = NextView(data)) > 0) {
+        handler(data, length);
+        ++drained;
     }
+    return drained;
 }
 
-void FecDecode::RemoveSeqRespondData(const uint32_t &seq) {
-    for(int i = 0; i < seq2data_pkgs_[seq].size(); ++i){
-        free(seq2data_pkgs_[seq][i]);
-        seq2data_pkgs_[seq][i] = nullptr;
+template<typename Lock>
+int32_t FecDecodeT<Lock>::NextView(const char *&data) {
+    if (raw_count_ > 0) {
+        const FecDecodeRawEntry entry = raw_queue_[raw_head_];
+        views_out_ = true;
+        data = entry.buffer + 4;
+        PopRaw();
+        return entry.length;
+    }
+    if (window_decoder_.NextOutputLength() > 0) {
+        ///the sliding window keeps its packets in its own ring, copy one out to a held buffer
+        char *buffer = pool_.Acquire();
+        const int32_t data_length = window_decoder_.NextOutputLength();
+        window_decoder_.Output(buffer, pool_.buffer_size());
+        window_ready_length_ = window_decoder_.NextOutputLength();
+        views_out_ = true;
+        held_buffers_.push_back(buffer);
+        data = buffer;
+        return data_length;
     }
-    seq2data_pkgs_num_.erase(seq);
-    seq2redundant_data_pkgs_num_.erase(seq);
-    seq2max_data_pkg_length_.erase(seq);
-    Sptr2TimeoutMap_->Remove(seq);
-    seq2data_pkgs_.erase(seq);
-    seq2data_pkgs_length_.erase(seq);
-    seq2cur_recv_data_pkg_num_.erase(seq);
-    seq2ready_for_output_.erase(seq);
+    if (NextOutputLength() == 0)
+        return 0;
+    const FecDecodeOutputEntry &entry = output_queue_[output_head_];
+    const FecDecodeGroup &group = groups_[entry.seq % kFecDecodeWindow];
+    const int32_t data_length = group.lengths[entry.index];
+    views_out_ = true;
+    data = group.shards[entry.index];
+    PopOutput();
+    return data_length;
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::ReleaseViews() {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    views_out_ = false;
+    for (auto buffer : held_buffers_)
+        pool_.Release(buffer);
+    held_buffers_.clear();
+}
+
+template<typename Lock>
+int32_t FecDecodeT<Lock>::PendingLength() {
+    window_ready_length_ = window_decoder_.NextOutputLength();
+    if (raw_count_ > 0)
+        return raw_queue_[raw_head_].length;
+    if (window_ready_length_ > 0)
+        return window_ready_length_;
+    return NextOutputLength();
+}
+
+template<typename Lock>
+void FecDecodeT<Lock>::ClearTimeoutDatas(const uint64_t &cur_millsec) {
+    std::lock_guard<Lock> lck(seq_mutex_);
+    ClearTimeoutDatasLocked(cur_millsec);
 }
 
+template<typename Lock>
+void FecDecodeT<Lock>::ClearTimeoutDatas() {
+    ClearTimeoutDatas(getnowtime_ms());
+}
 
+template<typename Lock>
+void FecDecodeT<Lock>::ClearTimeoutDatasLocked(const uint64_t &cur_millsec) {
+    timeout_wheel_.Advance(cur_millsec, [this](TimingWheelTimer *timer) {
+        FecDecodeGroup &group = groups_[timer->data];
+        ///the timer is cancelled once a group is decoded, still check to be safe, late
+        ///shards of it must not start the group again
+        if (group.state == kFecGroupFilling)
+            AbandonGroup(group);
+    });
+}
 
+template<typename Lock>
+void FecDecodeT<Lock>::SettleGroups(const uint16_t &newest, const int32_t &shard_num) {
+    if (!loss_started_ || SeqDiff(newest, settled_seq_) > kFecDecodeWindow) {
+        ///first group, or the peer restarted with another seq, start over from here
+        loss_started_ = true;
+        settled_seq_ = newest;
+        for (int32_t i = 0; i < kFecSettleDistance; ++i)
+            settled_seq_ = settled_seq_ <= 1 ? kFecSeqMax : settled_seq_ - 1;
+        return;
+    }
+    while (SeqDiff(newest, settled_seq_) > kFecSettleDistance) {
+        settled_seq_ = NextSeq(settled_seq_);
+        const FecDecodeGroup &group = groups_[settled_seq_ % kFecDecodeWindow];
+        if (group.seq == settled_seq_ && group.seen_bitmap.any()) {
+            loss_expected_ += group.data_pkg_num + group.redundant_pkg_num;
+            loss_received_ += group.seen_bitmap.count();
+        } else {
+            ///not a single shard of the group arrived, assume it had the current shape
+            loss_expected_ += shard_num;
+        }
+    }
+}
 
+template<typename Lock>
+void FecDecodeT<Lock>::CountWindowSource(const uint16_t &esi) {
+    const int32_t d = static_cast<int16_t>(static_cast<uint16_t>(esi - window_loss_esi_));
+    if (!window_loss_started_ || d >= kFecWindowKeep || d <= -kFecWindowKeep) {
+        ///first source packet, or the peer restarted with another esi
+        window_loss_started_ = true;
+        window_loss_esi_ = esi;
+        ++loss_expected_;
+        ++loss_received_;
+        return;
+    }
+    if (d > 0) {
+        loss_expected_ += d;
+        window_loss_esi_ = esi;
+    }
+    ///a reordered one was counted as lost when a newer one arrived
+    ++loss_received_;
+}
 
+template<typename Lock>
+int32_t FecDecodeT<Lock>::Feedback(char *buf, const int32_t &length, const uint64_t &cur_millsec) {
+    if (buf == nullptr || length < kFecFeedbackLength)
+        return -1;
+    std::lock_guard<Lock> lck(seq_mutex_);
+    if (loss_expected_ == 0 || cur_millsec < last_feedback_ms_ + kFecFeedbackIntervalMs)
+        return 0;
+    FecFeedback feedback;
+    feedback.received = loss_received_;
+    feedback.expected = loss_expected_;
+    loss_received_ = loss_expected_ = 0;
+    last_feedback_ms_ = cur_millsec;
+    return WriteFecFeedback(buf, feedback);
+}
 
+template<typename Lock>
+void FecDecodeT<Lock>::SetFeedbackHandler(std::function<void(const FecFeedback &)> handler) {
+    feedback_handler_ = std::move(handler);
+}
 
+///the thread safe decoder and the one of a single event loop
+template class FecDecodeT<std::mutex>;
+template class FecDecodeT<NullLock>;
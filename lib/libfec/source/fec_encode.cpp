@@ -4,17 +4,79 @@
 
 #include <cstring>
 #include <algorithm>
+#include <cmath>
 #include "fec_encode.h"
+#include "fec_codec.h"
+#include "fec16.h"
 #include "libfec_random_generator.h"
 #include "common.h"
 
-FecEncode::FecEncode(const int32_t &data_pkg_num, const int32_t &redundant_pkg_num, const uint32_t &timeout)
+namespace {
+
+struct FecShape {
+  int32_t data_pkg_num;
+  int32_t redundant_pkg_num;
+};
+
+///group shapes ordered by redundancy, m / k, the ladder table below is generated from
+///this list so every shape the encoder can pick has a compile-time parity matrix
+typedef FecCodecSet<FecCodec<10, 1>, FecCodec<8, 2>, FecCodec<6, 2>, FecCodec<4, 2>,
+                    FecCodec<3, 2>, FecCodec<4, 4>, FecCodec<3, 4>, FecCodec<2, 4>> FecLadderCodecs;
+
+template<typename CodecSet>
+struct FecShapeTable;
+
+template<typename... Codecs>
+struct FecShapeTable<FecCodecSet<Codecs...>> {
+  static const FecShape kShapes[sizeof...(Codecs)];
+};
+
+template<typename... Codecs>
+const FecShape FecShapeTable<FecCodecSet<Codecs...>>::kShapes[sizeof...(Codecs)] = {
+    {Codecs::kDataNum, Codecs::kParityNum}...};
+
+const FecShape *const kFecShapeLadder = FecShapeTable<FecLadderCodecs>::kShapes;
+const int32_t kFecShapeNum = FecLadderCodecs::kSize;
+///share of the data shards fec may leave lost, kcp retransmits the rest
+const double kFecTargetResidualLoss = 0.002;
+///a cheaper shape has to hold at this many times the measured loss
+const double kFecStepDownMargin = 2.0;
+///for this many reports in a row before the encoder steps down
+const int32_t kFecStepDownRounds = 3;
+
+///expected share of data shards a (k, m) group can not deliver with independent shard loss p
+double ResidualLoss(const FecShape &shape, double p) {
+    const int32_t n = shape.data_pkg_num + shape.redundant_pkg_num;
+    p = std::min(p, 0.99);
+    double prob = std::pow(1 - p, n), residual = 0;
+    for (int32_t lost = 0; lost <= n; ++lost) {
+        ///more losses than parity, every data shard is gone with probability lost / n
+        if (lost > shape.redundant_pkg_num)
+            residual += prob * lost / n;
+        prob = prob * (n - lost) / (lost + 1) * p / (1 - p);
+    }
+    return residual;
+}
+
+}
+
+template<typename Lock>
+FecEncodeT<Lock>::FecEncodeT(const int32_t &data_pkg_num, const int32_t &redundant_pkg_num, const uint32_t &timeout,
+                             const bool &xor_parity, const bool &adaptive)
     : inside_timer_(0),
-      cur_data_pkgs_num_(0),
-      max_data_pkg_length_(0),
-      ready_for_fec_output_(false),
+      expired_buckets_(0),
       data_pkg_num_(data_pkg_num),
       redundant_pkg_num_(redundant_pkg_num),
+      max_interleave_(1),
+      latency_budget_ms_(0),
+      xor_parity_(xor_parity),
+      adaptive_(adaptive),
+      gf16_(false),
+      crc_(false),
+      loss_(0),
+      loss_valid_(false),
+      shape_rung_(-1),
+      calm_rounds_(0),
       timeout_time_(timeout) {
     RandomNumberGenerator *rg = RandomNumberGenerator::GetInstance();
     auto ret = rg->GetRandomNumberU16(seq);
@@ -22,138 +84,382 @@ FecEncode::FecEncode(const int32_t &data_pkg_num, const int32_t &redundant_pkg_n
         seq = 1;
     }
     ///65521 is the max primer number in the range of 0-65535
-    if (seq >= 65521)
+    if (seq == 0 || seq > kFecSeqMax)
         seq = 1;
-    data_pkgs_length_.resize(data_pkg_num + redundant_pkg_num);
-    data_pkgs_.resize(data_pkg_num + redundant_pkg_num);
-    for (auto &data_pkg_length : data_pkgs_length_)
-        data_pkg_length = 0;
-    for (int i = 0; i < data_pkgs_.size(); ++i)
-        data_pkgs_[i] = nullptr;
+    SetSizeClasses(std::vector<FecSizeClass>());
 }
 
-FecEncode::~FecEncode() {
-    std::lock_guard<std::mutex> lck(data_pkgs_mutex_);
-    ResetDataPkgs();
-}
+template<typename Lock>
+FecEncodeT<Lock>::~FecEncodeT() = default;
 
-int32_t FecEncode::Input(const char *input_data_pkg, int32_t length) {
-    uint64_t time_temp = inside_timer_;
-    newest_update_time_ = time_temp;
-    std::lock_guard<std::mutex> lck(data_pkgs_mutex_);
-    if (cur_data_pkgs_num_ == data_pkg_num_)
-        return -1;
+template<typename Lock>
+int32_t FecEncodeT<Lock>::Input(const char *input_data_pkg, int32_t length) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
     if (input_data_pkg == nullptr || length <= 0 || length > 65535)
         return -2;
-    if (cur_data_pkgs_num_ == 0) {
-        ready_for_fec_output_ = false;
-        max_data_pkg_length_ = 0;
-        ResetDataPkgs();
+    int32_t bucket_index = 0;
+    while (length > buckets_[bucket_index].size_class.max_length)
+        ++bucket_index;
+    FecEncodeBucket &bucket = buckets_[bucket_index];
+    ///the parity of the last round has not been fetched by Output yet
+    if (bucket.round_complete)
+        return -1;
+    if (bucket.round_pkgs_num == 0)
+        StartRound(bucket);
+    FecEncodeGroup &group = bucket.groups[bucket.round_pkgs_num % bucket.interleave];
+    if (group.cur_data_pkgs_num == 0) {
+        group.seq = seq;
+        group.max_data_pkg_length = 0;
+        NextSeq();
     }
     ///因为实际上我们添加的fec头部是不进入fec编码的
-    max_data_pkg_length_ = std::max(length, static_cast<int32_t >(max_data_pkg_length_));
-    length += fec_encode_head_length_;
-    data_pkgs_[cur_data_pkgs_num_] = (char *) malloc((length + 1) * sizeof(char));
-    data_pkgs_length_[cur_data_pkgs_num_] = length;
-    bzero(data_pkgs_[cur_data_pkgs_num_], length + 1);
-    write_u32(data_pkgs_[cur_data_pkgs_num_], unique_header_);
-    write_u16(data_pkgs_[cur_data_pkgs_num_] + 4, seq);
-    write_u16(data_pkgs_[cur_data_pkgs_num_] + 6, length - fec_encode_head_length_);
-    data_pkgs_[cur_data_pkgs_num_][8] = (unsigned char) data_pkg_num_;
-    data_pkgs_[cur_data_pkgs_num_][9] = (unsigned char) redundant_pkg_num_;
+    group.max_data_pkg_length = std::max(length, group.max_data_pkg_length);
+    ///one more byte for the zero padding of the gf16 code to an even length
+    if (kFecSlotHeadroom + length + 1 > bucket.slot_size)
+        GrowArena(bucket, kFecSlotHeadroom + length + 1);
+    FecHeader header;
+    header.seq = group.seq;
+    header.length = static_cast<uint16_t>(length);
+    header.data_pkg_num = static_cast<uint8_t>(bucket.data_pkg_num);
+    header.redundant_pkg_num = static_cast<uint8_t>(bucket.redundant_pkg_num);
     ///注意这里索引不能用0,用0的话可能导致在不注意的情况下字符串数据被截断,也就是将0作为结束的标志了,所以改成从1开始
-    data_pkgs_[cur_data_pkgs_num_][10] = (unsigned char) (cur_data_pkgs_num_ + 1);
-    memcpy(data_pkgs_[cur_data_pkgs_num_] + fec_encode_head_length_, input_data_pkg, length - fec_encode_head_length_);
-    cur_data_pkgs_num_++;
-    if (cur_data_pkgs_num_ == data_pkg_num_) {
-        char **data = nullptr;
-        data = (char **) malloc((data_pkg_num_ + redundant_pkg_num_) * sizeof(char *));
-        for (int32_t i = 0; i < data_pkg_num_ + redundant_pkg_num_; ++i) {
-            ///注意这里必须要为每个数据包重新分配更大的空间,否则空间不够的情况下有些编码的数据会丢失
-            data[i] = (char *) malloc((max_data_pkg_length_ + fec_encode_head_length_ + 1) *
-                sizeof(char));
-            bzero(data[i], (max_data_pkg_length_ + fec_encode_head_length_ + 1) * sizeof(char));
-            if (i < data_pkg_num_) {
-                memcpy(data[i], data_pkgs_[i], data_pkgs_length_[i]);
-                free(data_pkgs_[i]);
-                data_pkgs_[i] = nullptr;
-            } else {
-                write_u32(data[i], unique_header_);
-                write_u16(data[i] + 4, seq);
-                write_u16(data[i] + 6, max_data_pkg_length_);
-                data[i][8] = (unsigned char) data_pkg_num_;
-                data[i][9] = (unsigned char) redundant_pkg_num_;
-            }
-            data[i][10] = (unsigned char) (i + 1);
-            ///因为实际上我们添加的fec头部是不进入fec编码的
-            data[i] += fec_encode_head_length_;
+    header.index = static_cast<uint8_t>(group.cur_data_pkgs_num + 1);
+    header.flags = bucket.flags;
+    const int32_t slot = group.first_slot + group.cur_data_pkgs_num;
+    char *pkg = bucket.data_pkgs[slot];
+    WriteFecHeader(pkg, header);
+    memcpy(pkg + bucket.head_length, input_data_pkg, length);
+    bucket.data_pkgs_length[slot] = length + bucket.head_length;
+    SealFecHeader(pkg, bucket.data_pkgs_length[slot]);
+    ///the data shard is sent right away, parity follows once the group is complete
+    pending_slots_.emplace_back(bucket_index, slot);
+    group.cur_data_pkgs_num++;
+    bucket.round_pkgs_num++;
+    if (group.cur_data_pkgs_num == bucket.data_pkg_num)
+        EncodeGroup(bucket, group);
+    if (bucket.round_pkgs_num == bucket.interleave * bucket.data_pkg_num) {
+        bucket.round_complete = true;
+        bucket.pkg_interval_ms = static_cast<double>(getnowtime_ms() - bucket.round_start_ms) / bucket.round_pkgs_num;
+    }
+    return 1;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::EncodeGroup(FecEncodeBucket &bucket, FecEncodeGroup &group) {
+    const int32_t max_length = group.max_data_pkg_length;
+    ///a group closed by its deadline is encoded over the k' data shards it got,
+    ///its parity carries k' so the decoder knows the group is short
+    const int32_t k = group.cur_data_pkgs_num, m = bucket.redundant_pkg_num;
+    ///the gf16 code works on 16 bits symbols
+    const int32_t shard_length = (bucket.flags & kFecFlagGf16) ? (max_length + 1) & ~1 : max_length;
+    FecHeader header;
+    header.seq = group.seq;
+    header.length = static_cast<uint16_t>(max_length);
+    header.data_pkg_num = static_cast<uint8_t>(k);
+    header.redundant_pkg_num = static_cast<uint8_t>(m);
+    header.flags = bucket.flags;
+    const int32_t bucket_index = static_cast<int32_t>(&bucket - buckets_.data());
+    for (int32_t i = 0; i < k + m; ++i) {
+        ///parity keeps its slots behind the full k data slots
+        const int32_t slot = group.first_slot + (i < k ? i : bucket.data_pkg_num + i - k);
+        shards_[i] = bucket.data_pkgs[slot] + bucket.head_length;
+        if (i < k) {
+            ///shorter shards are encoded as if zero padded to the longest one
+            const int32_t length_i = bucket.data_pkgs_length[slot] - bucket.head_length;
+            bzero(shards_[i] + length_i, shard_length - length_i);
+        } else {
+            header.index = static_cast<uint8_t>(i + 1);
+            WriteFecHeader(bucket.data_pkgs[slot], header);
+            bucket.data_pkgs_length[slot] = shard_length + bucket.head_length;
+            pending_slots_.emplace_back(bucket_index, slot);
         }
-        rs_encode2(data_pkg_num_, data_pkg_num_ + redundant_pkg_num_, data, max_data_pkg_length_);
-        for (int32_t i = 0; i < data_pkg_num_ + redundant_pkg_num_; ++i) {
-            data[i] -= fec_encode_head_length_;
-            data_pkgs_[i] = data[i];
+    }
+    ///parity is written straight into its own slots
+    char **data = shards_.data();
+    if (bucket.flags & kFecFlagXor) {
+        xor_encode(k, data, max_length);
+    } else if (bucket.flags & kFecFlagGf16) {
+        const size_t work_size = fec16_encode_work_size(k, m, shard_length);
+        if (fec16_work_.size() < work_size)
+            fec16_work_.resize(work_size);
+        fec16_encode(k, m, data, shard_length, fec16_work_.data());
+    } else if (FecLadderCodecs::Encode(k, m, data, max_length) < 0 && FecCodecEncode(k, m, data, max_length) < 0) {
+        rs_encode2(k, k + m, data, max_length);
+    }
+    if (bucket.flags & kFecFlagCrc) {
+        for (int32_t j = 0; j < m; ++j) {
+            const int32_t slot = group.first_slot + bucket.data_pkg_num + j;
+            SealFecHeader(bucket.data_pkgs[slot], bucket.data_pkgs_length[slot]);
         }
-        for (int32_t i = 0; i < data_pkg_num_ + redundant_pkg_num_; ++i) {
-            data_pkgs_length_[i] = max_data_pkg_length_ + fec_encode_head_length_;
+    }
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::TakePending(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
+    data_pkgs.resize(pending_slots_.size());
+    data_pkgs_length.resize(pending_slots_.size());
+    for (size_t i = 0; i < pending_slots_.size(); ++i) {
+        const FecEncodeBucket &bucket = buckets_[pending_slots_[i].first];
+        data_pkgs[i] = bucket.data_pkgs[pending_slots_[i].second];
+        data_pkgs_length[i] = bucket.data_pkgs_length[pending_slots_[i].second];
+    }
+    pending_slots_.clear();
+    ///every parity of those rounds has gone out too, the next Input starts a new round
+    for (auto &bucket : buckets_) {
+        if (bucket.round_complete) {
+            bucket.round_complete = false;
+            bucket.round_pkgs_num = 0;
         }
-        free(data);
-        ready_for_fec_output_ = true;
-        seq++;
-        ///65521 is the max prime number smaller than the max number in uint16_t
-        if (seq >= 65521)
-            seq = 1;
-        return 1;
     }
-    return 0;
 }
 
-int32_t FecEncode::Output(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
-    std::lock_guard<std::mutex> lck(data_pkgs_mutex_);
-    if (!ready_for_fec_output_) {
+template<typename Lock>
+int32_t FecEncodeT<Lock>::Output(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    if (pending_slots_.empty()) {
         return -1;
     }
-    data_pkgs = data_pkgs_;
-    data_pkgs_length = data_pkgs_length_;
-    cur_data_pkgs_num_ = 0;
+    TakePending(data_pkgs, data_pkgs_length);
     return 0;
 }
 
-int32_t FecEncode::FecEncodeUpdateTime(const uint64_t &cur_millsec) {
-    if (inside_timer_ == 0) {
-        newest_update_time_ = inside_timer_ = cur_millsec;
-        return 0;
-    }
+template<typename Lock>
+int32_t FecEncodeT<Lock>::FecEncodeUpdateTime(const uint64_t &cur_millsec) {
     if (cur_millsec < inside_timer_)
         return -1;
     inside_timer_ = cur_millsec;
-    if ((cur_millsec - newest_update_time_) < (timeout_time_ * 1000))
-        return 0;
-    ///means we have waited for the next data package for longer time than timeout
-    return 1;
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    int32_t expired_num = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        const FecEncodeBucket &bucket = buckets_[i];
+        if (bucket.round_pkgs_num == 0 || bucket.round_complete)
+            continue;
+        ///means the first package of the open round has waited longer than the deadline
+        if (static_cast<int64_t>(cur_millsec) - bucket.round_start_ms >= bucket.size_class.deadline_ms) {
+            expired_buckets_ |= 1u << i;
+            ++expired_num;
+        }
+    }
+    return expired_num;
 }
 
-int32_t FecEncode::FlushUnEncodedData(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
-    std::lock_guard<std::mutex> lck(data_pkgs_mutex_);
-    if (cur_data_pkgs_num_ == data_pkg_num_)
-        return -1;
-    data_pkgs.resize(cur_data_pkgs_num_);
-    data_pkgs_length.resize(cur_data_pkgs_num_);
-    for (int i = 0; i < cur_data_pkgs_num_; ++i) {
-        data_pkgs[i] = data_pkgs_[i] + fec_encode_head_length_ - sizeof(unique_header_);
-        ///we just add reverse unique header before the head of unencoded data package
-        write_u32_r(data_pkgs[i], unique_header_);
-        data_pkgs_length[i] = data_pkgs_length_[i] - fec_encode_head_length_ + sizeof(unique_header_);
-    }
-    cur_data_pkgs_num_ = 0;
+template<typename Lock>
+int64_t FecEncodeT<Lock>::NextDeadline() {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    int64_t deadline = -1;
+    for (const FecEncodeBucket &bucket : buckets_) {
+        if (bucket.round_pkgs_num == 0 || bucket.round_complete)
+            continue;
+        const int64_t bucket_deadline = bucket.round_start_ms + bucket.size_class.deadline_ms;
+        if (deadline < 0 || bucket_deadline < deadline)
+            deadline = bucket_deadline;
+    }
+    return deadline;
+}
+
+template<typename Lock>
+int32_t FecEncodeT<Lock>::FlushUnEncodedData(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    const uint32_t flushed = expired_buckets_ != 0 ? expired_buckets_ : ~0u;
+    expired_buckets_ = 0;
+    ///the data shards have been handed out by Input already, the groups still open
+    ///get parity over the shards they have, so a sparse stream is protected too
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        FecEncodeBucket &bucket = buckets_[i];
+        if (!(flushed & (1u << i)) || bucket.round_complete)
+            continue;
+        for (int32_t g = 0; g < bucket.interleave && bucket.round_pkgs_num > 0; ++g) {
+            FecEncodeGroup &group = bucket.groups[g];
+            if (group.cur_data_pkgs_num > 0 && group.cur_data_pkgs_num < bucket.data_pkg_num)
+                EncodeGroup(bucket, group);
+        }
+        bucket.round_pkgs_num = 0;
+    }
+    TakePending(data_pkgs, data_pkgs_length);
     return 0;
 }
 
-void FecEncode::ResetDataPkgs() {
-    for (auto &data_pkg_length : data_pkgs_length_)
-        data_pkg_length = 0;
-    for (int i = 0; i < data_pkgs_.size(); ++i) {
-        free(data_pkgs_[i]);
-        data_pkgs_[i] = nullptr;
+template<typename Lock>
+void FecEncodeT<Lock>::NextSeq() {
+    seq++;
+    ///65521 is the max prime number smaller than the max number in uint16_t
+    if (seq > kFecSeqMax)
+        seq = 1;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::GrowArena(FecEncodeBucket &bucket, int32_t slot_size) {
+    if (slot_size > bucket.slot_size) {
+        slot_size = std::max(slot_size, bucket.slot_size * 2);
+        slot_size = (slot_size + 63) & ~63;
+    } else {
+        slot_size = bucket.slot_size;
+    }
+    const size_t arena_size = static_cast<size_t>(slot_size) * bucket.data_pkgs.size();
+    const int32_t offset = kFecSlotHeadroom - bucket.head_length;
+    ///only reached from ApplyShape at the start of a round of the bucket, when none of its
+    ///slots is left in pending_slots_, so the slots are just pointed at their new place
+    if (slot_size == bucket.slot_size && arena_size <= bucket.arena.size()) {
+        for (size_t i = 0; i < bucket.data_pkgs.size(); ++i)
+            bucket.data_pkgs[i] = &bucket.arena[i * slot_size] + offset;
+        return;
+    }
+    std::vector<char> arena(arena_size);
+    const int32_t n = bucket.data_pkg_num + bucket.redundant_pkg_num;
+    for (size_t i = 0; i < bucket.data_pkgs.size(); ++i) {
+        char *pkg = &arena[i * slot_size] + offset;
+        const FecEncodeGroup &group = bucket.groups[i / n];
+        ///the data shards input so far, and the parity of the groups already encoded this
+        ///round, which may still wait in pending_slots_ for Output
+        if (static_cast<int32_t>(i) - group.first_slot < group.cur_data_pkgs_num ||
+            group.cur_data_pkgs_num == bucket.data_pkg_num)
+            memcpy(pkg, bucket.data_pkgs[i], bucket.data_pkgs_length[i]);
+        bucket.data_pkgs[i] = pkg;
+    }
+    bucket.arena.swap(arena);
+    bucket.slot_size = slot_size;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::ApplyShape(FecEncodeBucket &bucket, const int32_t &data_pkg_num, const int32_t &redundant_pkg_num,
+                           const int32_t &interleave) {
+    bucket.data_pkg_num = data_pkg_num;
+    bucket.redundant_pkg_num = redundant_pkg_num;
+    bucket.interleave = interleave;
+    bucket.flags = FlagsOf(redundant_pkg_num);
+    bucket.head_length = FecHeaderLength(bucket.flags);
+    const int32_t n = data_pkg_num + redundant_pkg_num;
+    const int32_t slots = interleave * n;
+    bucket.data_pkgs_length.assign(slots, 0);
+    bucket.data_pkgs.resize(slots);
+    if (static_cast<int32_t>(shards_.size()) < n)
+        shards_.resize(n);
+    bucket.groups.resize(interleave);
+    for (int32_t i = 0; i < interleave; ++i) {
+        bucket.groups[i].first_slot = i * n;
+        bucket.groups[i].cur_data_pkgs_num = 0;
+    }
+    size_t pending_capacity = 0;
+    for (const auto &b : buckets_)
+        pending_capacity += b.data_pkgs.size();
+    pending_slots_.reserve(pending_capacity);
+    ///tiny classes keep tiny slots, GrowArena doubles them for the odd longer package
+    int32_t slot_size = kFecSlotHeadroom + bucket.size_class.max_length;
+    slot_size = slot_size < kFecInitialSlotSize ? slot_size : kFecInitialSlotSize;
+    GrowArena(bucket, bucket.slot_size > slot_size ? bucket.slot_size : slot_size);
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::StartRound(FecEncodeBucket &bucket) {
+    int32_t data_pkg_num = data_pkg_num_, redundant_pkg_num = redundant_pkg_num_;
+    if (shape_rung_ >= 0) {
+        data_pkg_num = kFecShapeLadder[shape_rung_].data_pkg_num;
+        redundant_pkg_num = kFecShapeLadder[shape_rung_].redundant_pkg_num;
+    }
+    ///a group of the round is complete after interleave * k packages, which has to fit
+    ///the latency budget at the package rate of the last round, unknown rate means no interleaving
+    int32_t interleave = 1;
+    if (max_interleave_ > 1 && bucket.pkg_interval_ms >= 0) {
+        const double group_ms = bucket.pkg_interval_ms * data_pkg_num;
+        interleave = group_ms <= 0 ? max_interleave_ :
+                     std::min(max_interleave_, static_cast<int32_t>(latency_budget_ms_ / group_ms));
+        interleave = std::max(interleave, 1);
+    }
+    if (data_pkg_num != bucket.data_pkg_num || redundant_pkg_num != bucket.redundant_pkg_num ||
+        interleave != bucket.interleave || FlagsOf(redundant_pkg_num) != bucket.flags)
+        ApplyShape(bucket, data_pkg_num, redundant_pkg_num, interleave);
+    for (auto &group : bucket.groups)
+        group.cur_data_pkgs_num = 0;
+    bucket.round_start_ms = getnowtime_ms();
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::SetSizeClasses(std::vector<FecSizeClass> size_classes) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    std::sort(size_classes.begin(), size_classes.end(),
+              [](const FecSizeClass &a, const FecSizeClass &b) { return a.max_length < b.max_length; });
+    if (size_classes.size() >= static_cast<size_t>(kFecMaxSizeClasses))
+        size_classes.resize(kFecMaxSizeClasses - 1);
+    if (size_classes.empty() || size_classes.back().max_length < 65535)
+        size_classes.push_back(FecSizeClass{65535, timeout_time_ * 1000});
+    else
+        size_classes.back().max_length = 65535;
+    pending_slots_.clear();
+    expired_buckets_ = 0;
+    buckets_.clear();
+    buckets_.resize(size_classes.size());
+    for (size_t i = 0; i < size_classes.size(); ++i) {
+        FecEncodeBucket &bucket = buckets_[i];
+        bucket.size_class = size_classes[i];
+        bucket.round_pkgs_num = 0;
+        bucket.round_complete = false;
+        bucket.round_start_ms = 0;
+        bucket.pkg_interval_ms = -1;
+        bucket.slot_size = 0;
+        bucket.head_length = kFecHeaderLength;
+        ApplyShape(bucket, data_pkg_num_, redundant_pkg_num_, 1);
+    }
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::SetInterleave(const int32_t &depth, const uint32_t &latency_budget_ms) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    max_interleave_ = std::max(1, std::min(depth, kFecMaxInterleave));
+    latency_budget_ms_ = latency_budget_ms;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::SetGf16(const bool &gf16) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    gf16_ = gf16;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::SetCrc(const bool &crc) {
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    crc_ = crc;
+}
+
+template<typename Lock>
+uint8_t FecEncodeT<Lock>::FlagsOf(const int32_t &redundant_pkg_num) const {
+    uint8_t flags = crc_ ? kFecFlagCrc : 0;
+    ///a single parity shard needs no galois field arithmetic at all
+    if (xor_parity_ && redundant_pkg_num == 1)
+        return flags | kFecFlagXor;
+    return gf16_ ? flags | kFecFlagGf16 : flags;
+}
+
+template<typename Lock>
+void FecEncodeT<Lock>::OnFeedback(const FecFeedback &feedback) {
+    if (!adaptive_ || feedback.expected == 0)
+        return;
+    const double sample = feedback.received >= feedback.expected ? 0 :
+                          1 - static_cast<double>(feedback.received) / feedback.expected;
+    std::lock_guard<Lock> lck(data_pkgs_mutex_);
+    loss_ = loss_valid_ ? 0.75 * loss_ + 0.25 * sample : sample;
+    loss_valid_ = true;
+    int32_t want = kFecShapeNum - 1;
+    for (int32_t i = 0; i < kFecShapeNum; ++i) {
+        if (ResidualLoss(kFecShapeLadder[i], loss_) <= kFecTargetResidualLoss) {
+            want = i;
+            break;
+        }
+    }
+    if (shape_rung_ < 0 || want > shape_rung_) {
+        shape_rung_ = want;
+        calm_rounds_ = 0;
+    } else if (want < shape_rung_ &&
+        ResidualLoss(kFecShapeLadder[shape_rung_ - 1], loss_ * kFecStepDownMargin) <= kFecTargetResidualLoss) {
+        ///one step at a time, and only once the link has stayed calm for a while
+        if (++calm_rounds_ >= kFecStepDownRounds) {
+            --shape_rung_;
+            calm_rounds_ = 0;
+        }
+    } else {
+        calm_rounds_ = 0;
     }
 }
 
+///the thread safe encoder and the one of a single event loop
+template class FecEncodeT<std::mutex>;
+template class FecEncodeT<NullLock>;
@@ -0,0 +1,133 @@
+//
+// Created by lwj on 2020/3/6.
+//
+
+#include "fec_header.h"
+#include "common.h"
+#include "crc32c.h"
+
+int32_t FecHeaderLength(const uint8_t &flags) {
+    if (flags == 0)
+        return kFecHeaderLength;
+    return (flags & kFecFlagCrc) ? kFecHeaderCrcLength : kFecHeaderExtLength;
+}
+
+int32_t WriteFecHeader(char *p, const FecHeader &header) {
+    write_u32(p, header.flags == 0 ? kFecHeaderMagic : kFecHeaderMagicExt);
+    write_u16(p + 4, header.seq);
+    write_u16(p + 6, header.length);
+    p[8] = static_cast<char>(header.data_pkg_num);
+    p[9] = static_cast<char>(header.redundant_pkg_num);
+    p[10] = static_cast<char>(header.index);
+    if (header.flags == 0)
+        return kFecHeaderLength;
+    p[11] = static_cast<char>(header.flags);
+    ///the crc is filled in by SealFecHeader
+    if (header.flags & kFecFlagCrc)
+        write_u32(p + kFecHeaderExtLength, 0);
+    return FecHeaderLength(header.flags);
+}
+
+int32_t ParseFecHeader(const char *pkg, const int32_t &length, FecHeader &header) {
+    if (pkg == nullptr || length < static_cast<int32_t>(sizeof(uint32_t)))
+        return -1;
+    auto magic = read_u32(pkg);
+    int32_t header_length = 0;
+    if (magic == kFecHeaderMagic)
+        header_length = kFecHeaderLength;
+    else if (magic == kFecHeaderMagicExt)
+        header_length = kFecHeaderExtLength;
+    else
+        return 0;
+    if (length < header_length)
+        return -1;
+    header.seq = read_u16(pkg + 4);
+    header.length = read_u16(pkg + 6);
+    header.data_pkg_num = static_cast<uint8_t>(pkg[8]);
+    header.redundant_pkg_num = static_cast<uint8_t>(pkg[9]);
+    header.index = static_cast<uint8_t>(pkg[10]);
+    header.flags = header_length == kFecHeaderExtLength ? static_cast<uint8_t>(pkg[11]) : 0;
+    if (header.flags & kFecFlagCrc) {
+        header_length = kFecHeaderCrcLength;
+        if (length < header_length)
+            return -1;
+    }
+    if (header.data_pkg_num == 0 || header.index == 0 ||
+        header.index > header.data_pkg_num + header.redundant_pkg_num)
+        return -1;
+    ///xor parity only exists for a single redundant shard
+    if ((header.flags & kFecFlagXor) && header.redundant_pkg_num != 1)
+        return -1;
+    if ((header.flags & kFecFlagXor) && (header.flags & kFecFlagGf16))
+        return -1;
+    return header_length;
+}
+
+namespace {
+
+uint32_t ShardCrc(const char *pkg, const int32_t &length) {
+    const uint32_t crc = crc32c(0, pkg, kFecHeaderExtLength);
+    return crc32c(crc, pkg + kFecHeaderCrcLength, length - kFecHeaderCrcLength);
+}
+
+}
+
+void SealFecHeader(char *pkg, const int32_t &length) {
+    if (read_u32(pkg) != kFecHeaderMagicExt || !(static_cast<uint8_t>(pkg[11]) & kFecFlagCrc))
+        return;
+    write_u32(pkg + kFecHeaderExtLength, ShardCrc(pkg, length));
+}
+
+bool VerifyFecHeader(const char *pkg, const int32_t &length) {
+    if (read_u32(pkg) != kFecHeaderMagicExt || !(static_cast<uint8_t>(pkg[11]) & kFecFlagCrc))
+        return true;
+    return read_u32(pkg + kFecHeaderExtLength) == ShardCrc(pkg, length);
+}
+
+int32_t WriteFecFeedback(char *p, const FecFeedback &feedback) {
+    write_u32(p, kFecFeedbackMagic);
+    write_u32(p + 4, feedback.received);
+    write_u32(p + 8, feedback.expected);
+    return kFecFeedbackLength;
+}
+
+int32_t ParseFecFeedback(const char *pkg, const int32_t &length, FecFeedback &feedback) {
+    if (pkg == nullptr || length < static_cast<int32_t>(sizeof(uint32_t)) || read_u32(pkg) != kFecFeedbackMagic)
+        return 0;
+    if (length < kFecFeedbackLength)
+        return -1;
+    feedback.received = read_u32(pkg + 4);
+    feedback.expected = read_u32(pkg + 8);
+    return kFecFeedbackLength;
+}
+
+int32_t WriteFecWindowHeader(char *p, const FecWindowHeader &header) {
+    write_u32(p, kFecWindowMagic);
+    write_u16(p + 4, header.esi);
+    p[6] = static_cast<char>(header.window);
+    p[7] = static_cast<char>(header.seed);
+    write_u16(p + 8, header.length);
+    return kFecWindowHeaderLength;
+}
+
+int32_t ParseFecWindowHeader(const char *pkg, const int32_t &length, FecWindowHeader &header) {
+    if (pkg == nullptr || length < static_cast<int32_t>(sizeof(uint32_t)) || read_u32(pkg) != kFecWindowMagic)
+        return 0;
+    if (length < kFecWindowHeaderLength)
+        return -1;
+    header.esi = read_u16(pkg + 4);
+    header.window = static_cast<uint8_t>(pkg[6]);
+    header.seed = static_cast<uint8_t>(pkg[7]);
+    header.length = read_u16(pkg + 8);
+    if (header.length > length - kFecWindowHeaderLength)
+        return -1;
+    return kFecWindowHeaderLength;
+}
+
+uint8_t FecWindowCoef(const uint16_t &esi, const uint8_t &seed, const int32_t &i) {
+    uint32_t x = esi * 0x9E3779B1u ^ seed * 0x85EBCA77u ^ static_cast<uint32_t>(i) * 0xC2B2AE3Du;
+    x ^= x >> 15;
+    x *= 0x2C1B3C6Du;
+    x ^= x >> 12;
+    return static_cast<uint8_t>(1 + x % 255);
+}
@@ -0,0 +1,248 @@
+//
+// Created by lwj on 2020/3/20.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "fec_window_decode.h"
+#include "fec.h"
+#include "gf_tables.h"
+#include "common.h"
+
+namespace {
+
+///signed distance a - b of two esis
+int32_t EsiDiff(const uint16_t &a, const uint16_t &b) {
+    return static_cast<int16_t>(static_cast<uint16_t>(a - b));
+}
+
+int32_t SlotOf(const uint16_t &esi) {
+    return esi % kFecWindowSpan;
+}
+
+void Scale(char *buf, const uint8_t &c, const size_t &length) {
+    const unsigned char *mul = fec_gf_tables.mul[c];
+    for (size_t i = 0; i < length; ++i)
+        buf[i] = static_cast<char>(mul[static_cast<uint8_t>(buf[i])]);
+}
+
+}
+
+FecWindowDecode::FecWindowDecode() : started_(false),
+                                     newest_(0),
+                                     sources_(kFecWindowSpan),
+                                     rows_(kFecWindowSpan),
+                                     output_queue_(kFecWindowSpan),
+                                     output_head_(0),
+                                     output_count_(0) {
+    for (auto &source : sources_) {
+        source.esi = 0;
+        source.present = false;
+    }
+    for (auto &row : rows_)
+        row.used = false;
+    scratch_.used = false;
+}
+
+int32_t FecWindowDecode::Input(const char *input_data_pkg, int32_t length) {
+    FecWindowHeader header;
+    if (ParseFecWindowHeader(input_data_pkg, length, header) <= 0)
+        return -1;
+    const char *payload = input_data_pkg + kFecWindowHeaderLength;
+    if (header.window > kFecWindowMaxSize || (header.window == 0 && header.length == 0) ||
+        (header.window > 0 && header.length < 2))
+        return -1;
+    ///too old for the window, whatever it could repair has been given up
+    const uint16_t first = static_cast<uint16_t>(header.esi - (header.window > 0 ? header.window - 1 : 0));
+    if (started_ && EsiDiff(first, newest_) <= -kFecWindowKeep)
+        return NextOutputLength();
+    Advance(header.esi);
+    if (header.window == 0) {
+        const FecWindowSource &source = sources_[SlotOf(header.esi)];
+        if (source.esi == header.esi && source.present)
+            return NextOutputLength();
+        AddSource(header.esi, payload, header.length);
+        Substitute(header.esi);
+    } else {
+        FecWindowRow &row = scratch_;
+        memset(row.coef, 0, sizeof(row.coef));
+        for (int32_t i = 0; i < header.window; ++i)
+            row.coef[SlotOf(static_cast<uint16_t>(first + i))] = FecWindowCoef(header.esi, header.seed, i);
+        row.payload.assign(payload, payload + header.length);
+        InsertRow(row);
+    }
+    SolveRows();
+    return NextOutputLength();
+}
+
+void FecWindowDecode::Advance(const uint16_t &esi) {
+    if (!started_) {
+        started_ = true;
+        newest_ = static_cast<uint16_t>(esi - 1);
+    }
+    const int32_t d = EsiDiff(esi, newest_);
+    if (d <= 0)
+        return;
+    ///a jump over the whole window, nothing kept is of use any more
+    if (d >= kFecWindowKeep) {
+        for (auto &row : rows_)
+            row.used = false;
+    }
+    for (int32_t i = 1; i <= std::min(d, kFecWindowSpan); ++i) {
+        FecWindowSource &source = sources_[SlotOf(static_cast<uint16_t>(newest_ + i))];
+        source.esi = static_cast<uint16_t>(newest_ + i);
+        source.present = false;
+    }
+    newest_ = esi;
+    ///the support of an equation starts at its pivot, so dropping the old pivots keeps
+    ///every coefficient inside the window
+    for (auto &row : rows_) {
+        if (row.used && !InRange(row.pivot))
+            row.used = false;
+    }
+}
+
+bool FecWindowDecode::InRange(const uint16_t &esi) const {
+    const int32_t d = EsiDiff(esi, newest_);
+    return d <= 0 && d > -kFecWindowKeep;
+}
+
+void FecWindowDecode::AddSource(const uint16_t &esi, const char *data, const int32_t &data_length) {
+    FecWindowSource &source = sources_[SlotOf(esi)];
+    source.esi = esi;
+    source.present = true;
+    source.symbol.resize(2 + data_length);
+    write_u16(source.symbol.data(), static_cast<uint16_t>(data_length));
+    memcpy(source.symbol.data() + 2, data, data_length);
+    QueueOutput(esi);
+}
+
+void FecWindowDecode::AddRow(FecWindowRow &row, const FecWindowRow &other, uint8_t c) {
+    fec_addmul(row.coef, other.coef, c, kFecWindowSpan);
+    if (row.payload.size() < other.payload.size())
+        row.payload.resize(other.payload.size(), 0);
+    fec_addmul(row.payload.data(), other.payload.data(), c, static_cast<int>(other.payload.size()));
+}
+
+void FecWindowDecode::Substitute(const uint16_t &esi) {
+    const int32_t slot = SlotOf(esi);
+    const std::vector<char> &symbol = sources_[slot].symbol;
+    for (auto &row : rows_) {
+        const uint8_t c = row.coef[slot];
+        if (!row.used || c == 0)
+            continue;
+        if (row.payload.size() < symbol.size())
+            row.payload.resize(symbol.size(), 0);
+        fec_addmul(row.payload.data(), symbol.data(), c, static_cast<int>(symbol.size()));
+        row.coef[slot] = 0;
+    }
+    ///the equation pivoted on esi lost its pivot, it may still pin down another one
+    FecWindowRow &pivot_row = rows_[slot];
+    if (pivot_row.used && pivot_row.pivot == esi) {
+        pivot_row.used = false;
+        std::swap(pivot_row.payload, scratch_.payload);
+        memcpy(scratch_.coef, pivot_row.coef, sizeof(scratch_.coef));
+        InsertRow(scratch_);
+    }
+}
+
+void FecWindowDecode::InsertRow(FecWindowRow &row) {
+    const uint16_t oldest = static_cast<uint16_t>(newest_ - kFecWindowKeep + 1);
+    int32_t pivot = -1;
+    for (int32_t d = 0; d < kFecWindowKeep; ++d) {
+        const uint16_t esi = static_cast<uint16_t>(oldest + d);
+        const int32_t slot = SlotOf(esi);
+        const uint8_t c = row.coef[slot];
+        if (c == 0)
+            continue;
+        const FecWindowSource &source = sources_[slot];
+        const FecWindowRow &other = rows_[slot];
+        if (source.esi == esi && source.present) {
+            if (row.payload.size() < source.symbol.size())
+                row.payload.resize(source.symbol.size(), 0);
+            fec_addmul(row.payload.data(), source.symbol.data(), c, static_cast<int>(source.symbol.size()));
+            row.coef[slot] = 0;
+        } else if (other.used && other.pivot == esi) {
+            ///other only reaches esis from its pivot on, which this loop has yet to visit
+            AddRow(row, other, c);
+        } else if (pivot < 0) {
+            pivot = d;
+        }
+    }
+    ///nothing new in it
+    if (pivot < 0)
+        return;
+    const uint16_t pivot_esi = static_cast<uint16_t>(oldest + pivot);
+    const int32_t pivot_slot = SlotOf(pivot_esi);
+    const uint8_t inverse = fec_gf_tables.inverse[row.coef[pivot_slot]];
+    Scale(reinterpret_cast<char *>(row.coef), inverse, kFecWindowSpan);
+    Scale(row.payload.data(), inverse, row.payload.size());
+    for (auto &other : rows_) {
+        if (other.used && other.coef[pivot_slot] != 0)
+            AddRow(other, row, other.coef[pivot_slot]);
+    }
+    row.used = true;
+    row.pivot = pivot_esi;
+    std::swap(rows_[pivot_slot], row);
+    row.used = false;
+}
+
+void FecWindowDecode::SolveRows() {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (auto &row : rows_) {
+            if (!row.used)
+                continue;
+            const int32_t pivot_slot = SlotOf(row.pivot);
+            bool single = true;
+            for (int32_t i = 0; i < kFecWindowSpan && single; ++i)
+                single = i == pivot_slot || row.coef[i] == 0;
+            if (!single)
+                continue;
+            row.used = false;
+            const uint32_t data_length = row.payload.size() < 2 ? 0 : read_u16(row.payload.data());
+            ///a rebuilt symbol that does not hold together, the peer sent garbage
+            if (data_length == 0 || data_length + 2 > row.payload.size())
+                continue;
+            AddSource(row.pivot, row.payload.data() + 2, static_cast<int32_t>(data_length));
+            Substitute(row.pivot);
+            progress = true;
+        }
+    }
+}
+
+void FecWindowDecode::QueueOutput(const uint16_t &esi) {
+    ///the caller stopped calling Output, drop the oldest queued source packet
+    if (output_count_ == kFecWindowSpan) {
+        output_head_ = (output_head_ + 1) % kFecWindowSpan;
+        --output_count_;
+    }
+    output_queue_[(output_head_ + output_count_) % kFecWindowSpan] = esi;
+    ++output_count_;
+}
+
+int32_t FecWindowDecode::NextOutputLength() {
+    ///skip the source packets that fell out of the window before they were output
+    while (output_count_ > 0) {
+        const uint16_t esi = output_queue_[output_head_];
+        const FecWindowSource &source = sources_[SlotOf(esi)];
+        if (source.esi == esi && source.present)
+            return static_cast<int32_t>(read_u16(source.symbol.data()));
+        output_head_ = (output_head_ + 1) % kFecWindowSpan;
+        --output_count_;
+    }
+    return 0;
+}
+
+int32_t FecWindowDecode::Output(char *recv_buf, int32_t length) {
+    const int32_t data_length = NextOutputLength();
+    if (data_length == 0)
+        return -1;
+    if (recv_buf == nullptr || length < data_length)
+        return -2;
+    memcpy(recv_buf, sources_[SlotOf(output_queue_[output_head_])].symbol.data() + 2, data_length);
+    output_head_ = (output_head_ + 1) % kFecWindowSpan;
+    --output_count_;
+    return NextOutputLength();
+}
@@ -0,0 +1,175 @@
+//
+// Created by lwj on 2020/3/20.
+//
+
+#include <cstring>
+#include <algorithm>
+#include "fec_window_encode.h"
+#include "fec.h"
+#include "libfec_random_generator.h"
+#include "common.h"
+
+template<typename Lock>
+FecWindowEncodeT<Lock>::FecWindowEncodeT(const int32_t &window, const int32_t &interval, const int32_t &repair_pkg_num,
+                                         const uint32_t &deadline_ms, const bool &adaptive)
+    : window_(std::max(1, std::min(window, kFecWindowMaxSize))),
+      interval_(std::max(1, interval)),
+      repair_pkg_num_(std::max(1, repair_pkg_num)),
+      deadline_ms_(deadline_ms),
+      inside_timer_(0),
+      sources_(window_),
+      sources_length_(window_, 0),
+      head_(0),
+      repairs_(repair_pkg_num_),
+      repairs_length_(repair_pkg_num_, 0),
+      sent_num_(0),
+      unprotected_num_(0),
+      unprotected_since_ms_(0),
+      seed_(0),
+      adaptive_(adaptive),
+      loss_(0) {
+    RandomNumberGenerator *rg = RandomNumberGenerator::GetInstance();
+    if (rg->GetRandomNumberU16(esi_) < 0)
+        esi_ = 1;
+    pending_pkgs_.reserve(1 + repair_pkg_num_);
+    pending_length_.reserve(1 + repair_pkg_num_);
+}
+
+template<typename Lock>
+FecWindowEncodeT<Lock>::~FecWindowEncodeT() = default;
+
+template<typename Lock>
+char *FecWindowEncodeT<Lock>::SlotOf(std::vector<char> &slot, const size_t &length) {
+    if (slot.size() < length)
+        slot.resize(std::max(length, static_cast<size_t>(2048)));
+    return slot.data();
+}
+
+template<typename Lock>
+int32_t FecWindowEncodeT<Lock>::Input(const char *input_data_pkg, int32_t length) {
+    if (input_data_pkg == nullptr || length <= 0 || length > 65535 - 2)
+        return -2;
+    std::lock_guard<Lock> lck(mutex_);
+    pending_pkgs_.clear();
+    pending_length_.clear();
+    FecWindowHeader header;
+    header.esi = esi_++;
+    header.window = 0;
+    header.seed = 0;
+    header.length = static_cast<uint16_t>(length);
+    char *pkg = SlotOf(sources_[head_], kFecWindowHeaderLength + length);
+    WriteFecWindowHeader(pkg, header);
+    memcpy(pkg + kFecWindowHeaderLength, input_data_pkg, length);
+    sources_length_[head_] = kFecWindowHeaderLength + length;
+    head_ = (head_ + 1) % window_;
+    pending_pkgs_.push_back(pkg);
+    pending_length_.push_back(kFecWindowHeaderLength + length);
+    sent_num_ = std::min(sent_num_ + 1, window_);
+    if (unprotected_num_++ == 0)
+        unprotected_since_ms_ = getnowtime_ms();
+    if (unprotected_num_ >= interval_)
+        EncodeRepairs();
+    return 1;
+}
+
+template<typename Lock>
+void FecWindowEncodeT<Lock>::EncodeRepairs() {
+    const int32_t n = sent_num_;
+    ///a repair symbol is the 2 bytes length of each source packet followed by its data,
+    ///so the decoder rebuilds the exact length instead of a zero padded one
+    int32_t symbol_length = 0;
+    for (int32_t i = 0; i < n; ++i)
+        symbol_length = std::max(symbol_length, sources_length_[(head_ - n + i + window_) % window_]);
+    symbol_length = symbol_length - kFecWindowHeaderLength + 2;
+    for (int32_t r = 0; r < repair_pkg_num_; ++r) {
+        FecWindowHeader header;
+        header.esi = static_cast<uint16_t>(esi_ - 1);
+        header.window = static_cast<uint8_t>(n);
+        header.seed = seed_++;
+        header.length = static_cast<uint16_t>(symbol_length);
+        char *pkg = SlotOf(repairs_[r], kFecWindowHeaderLength + symbol_length);
+        WriteFecWindowHeader(pkg, header);
+        char *symbol = pkg + kFecWindowHeaderLength;
+        bzero(symbol, symbol_length);
+        for (int32_t i = 0; i < n; ++i) {
+            const int32_t slot = (head_ - n + i + window_) % window_;
+            const int32_t data_length = sources_length_[slot] - kFecWindowHeaderLength;
+            const int c = FecWindowCoef(header.esi, header.seed, i);
+            char length_bytes[2];
+            write_u16(length_bytes, static_cast<uint16_t>(data_length));
+            fec_addmul(symbol, length_bytes, c, 2);
+            fec_addmul(symbol + 2, sources_[slot].data() + kFecWindowHeaderLength, c, data_length);
+        }
+        repairs_length_[r] = kFecWindowHeaderLength + symbol_length;
+        pending_pkgs_.push_back(pkg);
+        pending_length_.push_back(repairs_length_[r]);
+    }
+    unprotected_num_ = 0;
+}
+
+template<typename Lock>
+int32_t FecWindowEncodeT<Lock>::Output(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
+    std::lock_guard<Lock> lck(mutex_);
+    if (pending_pkgs_.empty())
+        return -1;
+    data_pkgs.assign(pending_pkgs_.begin(), pending_pkgs_.end());
+    data_pkgs_length.assign(pending_length_.begin(), pending_length_.end());
+    pending_pkgs_.clear();
+    pending_length_.clear();
+    return 0;
+}
+
+template<typename Lock>
+int32_t FecWindowEncodeT<Lock>::FecEncodeUpdateTime(const uint64_t &cur_millsec) {
+    if (cur_millsec < inside_timer_)
+        return -1;
+    inside_timer_ = cur_millsec;
+    std::lock_guard<Lock> lck(mutex_);
+    if (unprotected_num_ == 0 || static_cast<int64_t>(cur_millsec) - unprotected_since_ms_ < deadline_ms_)
+        return 0;
+    return 1;
+}
+
+template<typename Lock>
+int64_t FecWindowEncodeT<Lock>::NextDeadline() {
+    std::lock_guard<Lock> lck(mutex_);
+    if (unprotected_num_ == 0)
+        return -1;
+    return unprotected_since_ms_ + deadline_ms_;
+}
+
+template<typename Lock>
+void FecWindowEncodeT<Lock>::OnFeedback(const FecFeedback &feedback) {
+    if (!adaptive_ || feedback.expected == 0)
+        return;
+    const double sample = feedback.received >= feedback.expected ? 0 :
+                          1 - static_cast<double>(feedback.received) / feedback.expected;
+    std::lock_guard<Lock> lck(mutex_);
+    loss_ = 0.75 * loss_ + 0.25 * sample;
+    ///repair_pkg_num / (interval + repair_pkg_num) >= 2 * loss
+    int32_t want = window_;
+    if (loss_ > 0) {
+        const double interval = repair_pkg_num_ * (1 / (2 * loss_) - 1);
+        want = interval >= window_ ? window_ : std::max(1, static_cast<int32_t>(interval));
+    }
+    if (want < interval_)
+        interval_ = want;
+    else if (want > interval_)
+        ++interval_;
+}
+
+template<typename Lock>
+int32_t FecWindowEncodeT<Lock>::FlushUnEncodedData(std::vector<char *> &data_pkgs, std::vector<int32_t> &data_pkgs_length) {
+    std::lock_guard<Lock> lck(mutex_);
+    if (unprotected_num_ > 0)
+        EncodeRepairs();
+    data_pkgs.assign(pending_pkgs_.begin(), pending_pkgs_.end());
+    data_pkgs_length.assign(pending_length_.begin(), pending_length_.end());
+    pending_pkgs_.clear();
+    pending_length_.clear();
+    return 0;
+}
+
+///the thread safe encoder and the one of a single event loop
+template class FecWindowEncodeT<std::mutex>;
+template class FecWindowEncodeT<NullLock>;
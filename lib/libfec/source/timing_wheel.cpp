@@ -0,0 +1,109 @@
+//
+// Created by lwj on 2020/3/22.
+//
+
+#include "timing_wheel.h"
+#include <algorithm>
+
+TimingWheel::TimingWheel(const uint64_t &now_ms, const uint32_t &tick_ms)
+    : tick_ms_(std::max(tick_ms, 1u)),
+      slots_(kWheelLevels * kWheelSlots),
+      current_tick_(now_ms / tick_ms_),
+      now_ms_(now_ms),
+      size_(0) {
+    ///an empty slot is a head pointing to itself
+    for (auto &slot : slots_)
+        slot.prev = slot.next = &slot;
+}
+
+void TimingWheel::Schedule(TimingWheelTimer *timer, const uint64_t &delay_ms) {
+    Cancel(timer);
+    ///rounded up so it never fires early, from now_ms_ rather than the tick being walked so
+    ///a timer scheduled by on_expire does not fire again in the same Advance, and at least
+    ///one tick ahead as the current one has been processed already
+    timer->expire_tick = std::max((now_ms_ + delay_ms + tick_ms_ - 1) / tick_ms_, current_tick_ + 1);
+    Link(timer);
+    ++size_;
+}
+
+void TimingWheel::Cancel(TimingWheelTimer *timer) {
+    if (!Scheduled(timer))
+        return;
+    Unlink(timer);
+    --size_;
+}
+
+void TimingWheel::Link(TimingWheelTimer *timer) {
+    const uint64_t max_delta = (static_cast<uint64_t>(1) << (kWheelBits * kWheelLevels)) - 1;
+    if (timer->expire_tick < current_tick_)
+        timer->expire_tick = current_tick_;
+    ///a timer beyond the span of the wheel waits in the farthest slot and is relinked from there
+    const uint64_t expire_tick = std::min(timer->expire_tick, current_tick_ + max_delta);
+    const uint64_t delta = expire_tick - current_tick_;
+    int32_t level = 0;
+    while (level < kWheelLevels - 1 && delta >> (kWheelBits * (level + 1)))
+        ++level;
+    TimingWheelTimer *head = Slot(level, static_cast<int32_t>(
+        (expire_tick >> (kWheelBits * level)) & (kWheelSlots - 1)));
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void TimingWheel::Unlink(TimingWheelTimer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+}
+
+void TimingWheel::Cascade(const int32_t &level, const int32_t &index) {
+    TimingWheelTimer *head = Slot(level, index);
+    ///every timer of the slot is due within the span of the level below now
+    while (head->next != head) {
+        TimingWheelTimer *timer = head->next;
+        Unlink(timer);
+        Link(timer);
+    }
+}
+
+int32_t TimingWheel::Advance(const uint64_t &now_ms, const std::function<void(TimingWheelTimer *)> &on_expire) {
+    if (now_ms <= now_ms_)
+        return 0;
+    now_ms_ = now_ms;
+    const uint64_t target_tick = now_ms / tick_ms_;
+    ///nothing to expire on the way, jump straight there
+    if (size_ == 0) {
+        current_tick_ = std::max(current_tick_, target_tick);
+        return 0;
+    }
+    int32_t expired = 0;
+    TimingWheelTimer due;
+    while (current_tick_ < target_tick && size_ > 0) {
+        ++current_tick_;
+        ///a lower level wrapped, the next slot of the level above comes down
+        for (int32_t level = 1; level < kWheelLevels; ++level) {
+            if (current_tick_ & ((static_cast<uint64_t>(1) << (kWheelBits * level)) - 1))
+                break;
+            Cascade(level, static_cast<int32_t>((current_tick_ >> (kWheelBits * level)) & (kWheelSlots - 1)));
+        }
+        TimingWheelTimer *head = Slot(0, static_cast<int32_t>(current_tick_ & (kWheelSlots - 1)));
+        if (head->next == head)
+            continue;
+        ///move the slot aside first, on_expire may schedule timers into it again
+        due.next = head->next;
+        due.prev = head->prev;
+        due.next->prev = due.prev->next = &due;
+        head->prev = head->next = head;
+        while (due.next != &due) {
+            TimingWheelTimer *timer = due.next;
+            Unlink(timer);
+            --size_;
+            ++expired;
+            on_expire(timer);
+        }
+    }
+    if (current_tick_ < target_tick)
+        current_tick_ = target_tick;
+    return expired;
+}
@@ -3,14 +3,16 @@
 #include "ikcp.h"
 #include "parse_config.h"
 #include "fec_manager.h"
+#include "output_pacer.h"
+#include "batch_receiver.h"
 #include <glog/logging.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <sys/socket.h>
 
 int udpout(const char *buf, int len, ikcpcb *kcp, void *user) {
-    auto fec_encoder_manager = reinterpret_cast<kcptunnel::FecEncodeManager *> (user);
-    return fec_encoder_manager->Input(buf, len);
+    auto output_pacer = reinterpret_cast<kcptunnel::OutputPacer *> (user);
+    return output_pacer->Input(buf, len);
 }
 
 void run(int32_t epoll_fd,
@@ -18,18 +20,57 @@ void run(int32_t epoll_fd,
          int32_t remote_connected_fd,
          int32_t kcp_update_timer_fd,
          const kcptunnel::ip_port_t &ip_port) {
-    char recv_buf[4096] = {0};
-    int32_t recv_len = 0;
     const int32_t max_events = 64;
     struct epoll_event events[max_events];
-    FecDecode fec_decoder(10000);
+    SingleThreadFecDecode fec_decoder(10000);
     std::shared_ptr<kcptunnel::connection_info_t> sp_conn(new kcptunnel::connection_info_t);
     sp_conn->socket_fd_ = remote_connected_fd;
     sp_conn->isclient_ = true;
-    std::shared_ptr<FecEncode> sp_fec_encode(new FecEncode(2, 1, 10));
-    kcptunnel::FecEncodeManager fec_encode_manager(sp_conn, sp_fec_encode);
-    ikcpcb *kcp = ikcp_create(0x11112222, (void *) &fec_encode_manager);
+    auto system_config = SystemConfig::GetInstance("")->system_config();
+    ///the run loop is the only thread touching the encoder and the decoder, no locks needed
+    std::shared_ptr<SingleThreadFecEncode> sp_fec_encode(
+        new SingleThreadFecEncode(system_config->fec_data_shards, system_config->fec_parity_shards, 10,
+                                  system_config->fec_xor_parity, system_config->fec_adaptive));
+    sp_fec_encode->SetGf16(system_config->fec_codec == "gf16");
+    sp_fec_encode->SetCrc(system_config->fec_crc);
+    sp_fec_encode->SetInterleave(system_config->fec_interleave,
+                                 static_cast<uint32_t>(system_config->fec_latency_budget_ms));
+    std::vector<FecSizeClass> size_classes{{65535, static_cast<uint32_t>(system_config->fec_flush_deadline_ms)}};
+    if (system_config->fec_small_class_max_length > 0)
+        size_classes.push_back({system_config->fec_small_class_max_length,
+                                static_cast<uint32_t>(system_config->fec_small_class_deadline_ms)});
+    sp_fec_encode->SetSizeClasses(size_classes);
+    std::shared_ptr<SingleThreadFecWindowEncode> sp_fec_window_encode;
+    if (system_config->fec_mode == "window")
+        sp_fec_window_encode.reset(new SingleThreadFecWindowEncode(system_config->fec_window, system_config->fec_window_interval, 1,
+                                                                   static_cast<uint32_t>(system_config->fec_flush_deadline_ms),
+                                                                   system_config->fec_adaptive));
+    kcptunnel::SingleThreadFecEncodeManager fec_encode_manager(sp_conn, sp_fec_encode, sp_fec_window_encode);
+    fec_encode_manager.SetControlCopies(system_config->fec_control_copies);
+    ///loss reports of the peer retune our encoder
+    fec_decoder.SetFeedbackHandler([&fec_encode_manager](const FecFeedback &feedback) {
+        fec_encode_manager.OnFeedback(feedback);
+    });
+    ikcpcb *kcp = ikcp_create(0x11112222, nullptr);
     kcp->output = udpout;
+    ///kcp output is paced by a high resolution timer before it reaches fec encoder
+    int32_t pacing_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (pacing_timer_fd == -1 || kcptunnel::AddEvent2Epoll(epoll_fd, pacing_timer_fd, EPOLLIN) != 0) {
+        LOG(ERROR) << "failed to create pacing timer error:" << strerror(errno);
+        return;
+    }
+    kcptunnel::OutputPacer output_pacer(kcp, &fec_encode_manager, pacing_timer_fd);
+    ///open fec groups are flushed right at their deadline, not on the next kcp update
+    int32_t flush_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (flush_timer_fd == -1 || kcptunnel::AddEvent2Epoll(epoll_fd, flush_timer_fd, EPOLLIN) != 0) {
+        LOG(ERROR) << "failed to create fec flush timer error:" << strerror(errno);
+        return;
+    }
+    fec_encode_manager.SetFlushTimer(flush_timer_fd);
+    kcptunnel::BatchReceiver batch_receiver(remote_connected_fd, &fec_decoder);
+    kcp->user = &output_pacer;
+    if (ikcp_setcc(kcp, ikcp_cc_find(system_config->congestion_control.c_str())) < 0)
+        LOG(WARNING) << "unknown congestion_control:" << system_config->congestion_control << ", use classic";
     std::shared_ptr<kcptunnel::ConnectionManager>
         sp_conn_manager(new kcptunnel::ConnectionManager(local_listen_fd, ip_port, (void *) kcp));
     while (true) {
@@ -53,48 +94,28 @@ void run(int32_t epoll_fd,
             }
             else if(events[i].data.fd == remote_connected_fd){
                 ///获得从server端的数据
-                bzero(recv_buf, sizeof(recv_buf));
-                recv_len = recv(remote_connected_fd, recv_buf, sizeof(recv_buf), 0);
-                LOG(INFO) << "recv data from kcptunnel server recv_len:" << recv_len;
-                if (recv_len < 0) {
-                    LOG(ERROR) << "failed to recv data from remote server error:%s" << strerror(errno);
+                auto recv_num = batch_receiver.Receive();
+                LOG(INFO) << "recv datagrams from kcptunnel server num:" << recv_num;
+                if (recv_num <= 0)
                     continue;
-                }
-                ///we should first send to data to fec_decoder for decoding
-                auto len = fec_decoder.Input(recv_buf, recv_len);
-                while (len > 0) {
-                    ///说明数据已经被全部解码完成,需要发送给kcp处理
-                    char *recvbuf = (char *) malloc(len + 1);
-                    if (recvbuf == nullptr) {
-                        LOG(ERROR) << "failed to call malloc";
-                        break;
-                    }
-                    bzero(recvbuf, len + 1);
-                    auto ret = fec_decoder.Output(recvbuf, len);
-                    LOG(INFO)<<"success call decode data from server:"<<recvbuf;
-                    if (ret < 0) {
-                        LOG(ERROR) << "failed to get decoded data from fec_decoder";
-                        free(recvbuf);
-                        break;
-                    }
-                    if (auto temp = ikcp_input(kcp, recvbuf, len) < 0) {
-                        len = ret;
-                        LOG(WARNING) << "ikcp_input error:" << temp;
-                        free(recvbuf);
-                        continue;
-                    }
-                    len = ret;
-                    free(recvbuf);
-                }
+                ///decode the whole batch first, then kcp processes it with one ikcp_input_batch
+                batch_receiver.DecodeAndInput(kcp);
+            }
+            else if(events[i].data.fd == pacing_timer_fd){
+                output_pacer.OnTimer();
+            }
+            else if(events[i].data.fd == flush_timer_fd){
+                ///some fec group reached its deadline, flush out timeout data
+                fec_encode_manager.OnFlushTimer(kcptunnel::getnowtime_ms());
             }
             else if(events[i].data.fd == kcp_update_timer_fd){
                 ///we need to call ikcp_update
                 auto millisec = kcptunnel::getnowtime_ms();
                 ikcp_update(kcp, millisec);
-                auto temp_ret = sp_fec_encode->FecEncodeUpdateTime(millisec);
-                ///if fec_encode have timeout data, we just flush out timeout data
-                if(temp_ret > 0)
-                    fec_encode_manager.FlushUnEncodedData();
+                ///and tell the peer how much of its fec traffic got lost
+                fec_encode_manager.SendFeedback(&fec_decoder, millisec);
+                ///groups that will never complete are reclaimed as soon as they time out
+                fec_decoder.ClearTimeoutDatas(static_cast<uint64_t>(millisec));
                 ///maybe kcp has prepared data for us, so we call RecvDataFromPeer
                 sp_conn_manager->RecvDataFromPeer();
             }
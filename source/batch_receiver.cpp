@@ -0,0 +1,83 @@
+//
+// Created by lwj on 2020/3/4.
+//
+
+#include "batch_receiver.h"
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+
+namespace kcptunnel {
+
+BatchReceiver::BatchReceiver(const int32_t &socket_fd, SingleThreadFecDecode *fec_decoder)
+    : socket_fd_(socket_fd),
+      fec_decoder_(fec_decoder),
+      datagrams_(kBatchSize),
+      datagram_iovs_(kBatchSize),
+      addrs_(kBatchSize),
+      msgs_(kBatchSize) {
+    for (int32_t i = 0; i < kBatchSize; ++i) {
+        datagrams_[i] = fec_decoder_->AcquireBuffer();
+        datagram_iovs_[i].iov_base = datagrams_[i];
+        datagram_iovs_[i].iov_len = static_cast<size_t>(fec_decoder_->BufferSize());
+    }
+    decoded_iovs_.reserve(kBatchSize);
+}
+
+BatchReceiver::~BatchReceiver() {
+    for (auto datagram : datagrams_)
+        fec_decoder_->ReleaseBuffer(datagram);
+}
+
+int32_t BatchReceiver::Receive() {
+    received_ = 0;
+    for (int32_t i = 0; i < kBatchSize; ++i) {
+        memset(&msgs_[i], 0, sizeof(msgs_[i]));
+        msgs_[i].msg_hdr.msg_iov = &datagram_iovs_[i];
+        msgs_[i].msg_hdr.msg_iovlen = 1;
+        msgs_[i].msg_hdr.msg_name = &addrs_[i];
+        msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+    }
+    auto ret = recvmmsg(socket_fd_, msgs_.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+    if (ret < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            LOG(ERROR) << "failed to call recvmmsg error:" << strerror(errno);
+        return ret;
+    }
+    received_ = ret;
+    return received_;
+}
+
+int32_t BatchReceiver::DecodeAndInput(ikcpcb *kcp) {
+    decoded_iovs_.clear();
+    for (int32_t i = 0; i < received_; ++i) {
+        ///a datagram cut by the buffer size is not worth decoding
+        if (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC)
+            continue;
+        fec_decoder_->InputBuffer(datagrams_[i], static_cast<int32_t>(msgs_[i].msg_len));
+        datagram_iovs_[i].iov_base = datagrams_[i];
+    }
+    ///the decoder holds everything the batch prepared, the whole of it comes out at once
+    fec_decoder_->Drain([this](const char *data, int32_t length) {
+        decoded_iovs_.push_back({const_cast<char *>(data), static_cast<size_t>(length)});
+    });
+    const auto decoded_num = static_cast<int>(decoded_iovs_.size());
+    if (decoded_num == 0)
+        return 0;
+    auto accepted = ikcp_input_batch(kcp, decoded_iovs_.data(), decoded_num, 1);
+    ///kcp has copied what it keeps, the shards behind the views may be reused
+    fec_decoder_->ReleaseViews();
+    if (accepted != decoded_num)
+        LOG(WARNING) << "ikcp_input_batch dropped " << decoded_num - accepted << " malformed packets";
+    return accepted;
+}
+
+bool BatchReceiver::LastPeer(sockaddr_in &addr, socklen_t &slen) const {
+    if (received_ <= 0)
+        return false;
+    addr = addrs_[received_ - 1];
+    slen = msgs_[received_ - 1].msg_hdr.msg_namelen;
+    return true;
+}
+
+}
@@ -1,5 +1,7 @@
 #include <glog/logging.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
 #include "ikcp.h"
 #include "connection_manager.h"
 #include "kcptunnel_common.h"
@@ -7,6 +9,29 @@
 
 namespace kcptunnel {
 
+namespace {
+
+///points dst at len bytes of src starting at offset, returns the number of iovecs used
+int32_t slice_iovec(const struct iovec *src, const int32_t &src_count, size_t offset, size_t len,
+                    struct iovec *dst) {
+    int32_t count = 0;
+    for (int32_t i = 0; i < src_count && len > 0; ++i) {
+        if (offset >= src[i].iov_len) {
+            offset -= src[i].iov_len;
+            continue;
+        }
+        auto n = std::min(src[i].iov_len - offset, len);
+        dst[count].iov_base = static_cast<char *>(src[i].iov_base) + offset;
+        dst[count].iov_len = n;
+        ++count;
+        len -= n;
+        offset = 0;
+    }
+    return count;
+}
+
+}
+
 ConnectionManager::ConnectionManager(const int32_t &local_listen_fd, kcptunnel::ip_port_t ip_port, void *user_data) :
     local_listen_fd_(local_listen_fd), remote_server_info_(std::move(ip_port)), user_data_(user_data) {
     auto ret = set_non_blocking(local_listen_fd_);
@@ -40,104 +65,72 @@ int32_t ConnectionManager::HandleNewConnection() {
 
 int32_t ConnectionManager::RecvDataFromPeer() {
     auto kcp = (ikcpcb *) user_data_;
-    if (kcp->stream == 0) {
-        bzero(recv_buf_, sizeof(recv_buf_));
-        auto ret = ikcp_recv(kcp, recv_buf_, sizeof(recv_buf_));
-        ///means kcp does not have prepared data for us
-        if (ret <= 0) {
-            return 0;
-        }
-        if (ret <= header_len_) {
+    struct iovec segs[kMaxPeekSegments];
+    auto seg_count = ikcp_peekv(kcp, segs, kMaxPeekSegments);
+    if (seg_count == -2) {
+        auto message_len = ikcp_peeksize(kcp);
+        LOG(ERROR) << "kcptunnel message spans too many kcp segments, drop len:" << message_len;
+        ikcp_consume(kcp, message_len);
+        return -1;
+    }
+    ///means kcp does not have prepared data for us
+    if (seg_count <= 0) {
+        return 0;
+    }
+    size_t available = 0;
+    for (int32_t i = 0; i < seg_count; ++i)
+        available += segs[i].iov_len;
+    if (available <= static_cast<size_t>(header_len_)) {
+        if (kcp->stream == 0) {
             LOG(ERROR) << "wrong package without kcptunnel header!";
+            ikcp_consume(kcp, static_cast<int>(available));
             return -1;
         }
-        recv_len_ = ret;
-        auto unique_connId = read_u32(recv_buf_);
-        if (!connid2outside_connectionfd_.count(unique_connId)) {
-            ///only server will go this
-            int32_t connected_fd = -1;
-            ret = new_connected_socket(remote_server_info_.ip, remote_server_info_.port,
-                                       connected_fd, kcptunnel::TCP);
-            if (ret < 0) {
-                LOG(ERROR) << "failed to call new_connected_socket ret:" << ret;
-                return -2;
-            }
-            ret = set_non_blocking(connected_fd);
-            if (ret < 0)
-                LOG(WARNING) << "failed to call set_non_blocking on connected_fd:" << connected_fd;
-            outside_connectionfd_2connid_[connected_fd] = unique_connId;
-            connid2outside_connectionfd_[unique_connId] = connected_fd;
-        }
-        auto data_len = read_u16(recv_buf_ + sizeof(uint32_t));
-        if (data_len != (recv_len_ - header_len_)) {
-            LOG(ERROR) << "wrong package data_len is not equal to actual data length";
-            return -1;
+        ///stream mode, the rest of the header is still on the way
+        return 0;
+    }
+    ///the header itself may straddle two segments
+    char header[sizeof(uint32_t) + sizeof(uint16_t)];
+    struct iovec header_segs[sizeof(header)];
+    auto header_seg_count = slice_iovec(segs, seg_count, 0, sizeof(header), header_segs);
+    char *header_pos = header;
+    for (int32_t i = 0; i < header_seg_count; ++i) {
+        memcpy(header_pos, header_segs[i].iov_base, header_segs[i].iov_len);
+        header_pos += header_segs[i].iov_len;
+    }
+    auto unique_connId = read_u32(header);
+    auto data_len = read_u16(header + sizeof(uint32_t));
+    auto message_len = static_cast<size_t>(header_len_) + data_len;
+    if (kcp->stream == 0 && message_len != available) {
+        LOG(ERROR) << "wrong package data_len is not equal to actual data length";
+        ikcp_consume(kcp, static_cast<int>(available));
+        return -1;
+    }
+    if (available < message_len) {
+        if (seg_count == kMaxPeekSegments)
+            LOG(ERROR) << "kcptunnel message spans too many kcp segments len:" << message_len;
+        return 0;
+    }
+    if (!connid2outside_connectionfd_.count(unique_connId)) {
+        ///only server will go this
+        int32_t connected_fd = -1;
+        auto ret = new_connected_socket(remote_server_info_.ip, remote_server_info_.port,
+                                        connected_fd, kcptunnel::TCP);
+        if (ret < 0) {
+            LOG(ERROR) << "failed to call new_connected_socket ret:" << ret;
+            return -2;
         }
-        ret = SendDataToRemote();
+        ret = set_non_blocking(connected_fd);
         if (ret < 0)
-            LOG(ERROR) << "failed to call SendDataToRemote ret:" << ret;
-        return connid2outside_connectionfd_[unique_connId];
-    } else if (kcp->stream == 1) {
-        if (recv_len_ >= header_len_) {
-            auto unique_connid = read_u32(recv_buf_);
-            auto data_len = read_u16(recv_buf_ + sizeof(uint32_t));
-            auto rest_len = data_len - recv_len_ + header_len_;
-            auto ret = ikcp_recv(kcp, recv_buf_ + recv_len_, rest_len);
-            ///means kcp does not have prepared data for us
-            if (ret <= 0) {
-                return 0;
-            }
-            recv_len_ += ret;
-            if (recv_len_ == (data_len + header_len_)) {
-                ret = SendDataToRemote();
-                if (ret < 0)
-                    LOG(ERROR) << "failed to call SendDataToRemote ret:" << ret;
-            }
-            return connid2outside_connectionfd_[unique_connid];
-        }
-        if (recv_len_ < header_len_) {
-            auto ret = ikcp_recv(kcp, recv_buf_ + recv_len_, header_len_ - recv_len_);
-            if (ret <= 0) {
-                return 0;
-            }
-            recv_len_ += ret;
-            if (recv_len_ < header_len_)
-                return 0;
-        }
-        auto unique_connId = read_u32(recv_buf_);
-        if (!connid2outside_connectionfd_.count(unique_connId)) {
-            ///only server will go this
-            int32_t connected_fd = -1;
-            auto ret = new_connected_socket(remote_server_info_.ip, remote_server_info_.port,
-                                            connected_fd, kcptunnel::TCP);
-            if (ret < 0) {
-                LOG(ERROR) << "failed to call new_connected_socket ret:" << ret;
-                return -2;
-            }
-            ret = set_non_blocking(connected_fd);
-            if (ret < 0)
-                LOG(WARNING) << "failed to call set_non_blocking on connected_fd:" << connected_fd;
-            outside_connectionfd_2connid_[connected_fd] = unique_connId;
-            connid2outside_connectionfd_[unique_connId] = connected_fd;
-        }
-        auto data_len = read_u16(recv_buf_ + sizeof(uint32_t));
-        if (data_len > (sizeof(recv_buf_) - header_len_)) {
-            LOG(WARNING) << "too big data pkg len:" << data_len;
-            return -3;
-        }
-        auto ret = ikcp_recv(kcp, recv_buf_ + header_len_, data_len);
-        if (ret <= 0) {
-            return 0;
-        }
-        LOG(INFO) << "prepare to send data remote";
-        recv_len_ += ret;
-        if (recv_len_ == (data_len + header_len_)) {
-            ret = SendDataToRemote();
-            if (ret < 0)
-                LOG(ERROR) << "failed to call SendDataToRemote ret:" << ret;
-        }
-        return connid2outside_connectionfd_[unique_connId];
+            LOG(WARNING) << "failed to call set_non_blocking on connected_fd:" << connected_fd;
+        outside_connectionfd_2connid_[connected_fd] = unique_connId;
+        connid2outside_connectionfd_[unique_connId] = connected_fd;
     }
+    auto ret = SendDataToRemote(unique_connId, segs, seg_count, data_len);
+    if (ret < 0)
+        LOG(ERROR) << "failed to call SendDataToRemote ret:" << ret;
+    ikcp_consume(kcp, static_cast<int>(message_len));
+    return connid2outside_connectionfd_[unique_connId];
 }
 
 int32_t ConnectionManager::RecvDataFromOutside(const int32_t &readable_fd) {
@@ -145,8 +138,7 @@ int32_t ConnectionManager::RecvDataFromOutside(const int32_t &readable_fd) {
         LOG(ERROR) << "readable_fd is not recorded:" << readable_fd;
         return -1;
     }
-    bzero(recv_buf_, sizeof(recv_buf_));
-    auto ret = recv(readable_fd, recv_buf_ + header_len_, sizeof(recv_buf_) - header_len_, 0);
+    auto ret = recv(readable_fd, send_buf_, sizeof(send_buf_), 0);
     if (ret < 0) {
         LOG(ERROR) << "failed to call recv error" << strerror(errno);
         return -2;
@@ -159,57 +151,42 @@ int32_t ConnectionManager::RecvDataFromOutside(const int32_t &readable_fd) {
         connid2outside_connectionfd_.erase(conn_id);
         return 0;
     }
-    LOG(INFO) << "recv data from client len:" << ret << " data:" << recv_buf_ + header_len_;
+    LOG(INFO) << "recv data from client len:" << ret;
     auto data_len = static_cast<uint16_t >(ret);
-    write_u32(recv_buf_, outside_connectionfd_2connid_[readable_fd]);
-    write_u16(recv_buf_ + sizeof(uint32_t), data_len);
-    recv_len_ = data_len + header_len_;
+    char header[sizeof(uint32_t) + sizeof(uint16_t)];
+    write_u32(header, outside_connectionfd_2connid_[readable_fd]);
+    write_u16(header + sizeof(uint32_t), data_len);
+    ///header and payload go into the kcp segment in one pass, no staging copy
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = send_buf_;
+    iov[1].iov_len = data_len;
     auto kcp = (ikcpcb *) user_data_;
-    ret = ikcp_send(kcp, recv_buf_, recv_len_);
+    ret = ikcp_sendv(kcp, iov, 2);
     if (ret < 0) {
-        LOG(WARNING) << "failed to call ikcp_send ret:" << ret;
+        LOG(WARNING) << "failed to call ikcp_sendv ret:" << ret;
+        return -3;
     }
+    return 0;
 }
 
-int32_t ConnectionManager::SendDataToRemote() {
-    auto unique_connId = read_u32(recv_buf_);
-    auto ret = send(connid2outside_connectionfd_[unique_connId], recv_buf_ + header_len_, recv_len_ - header_len_, 0);
+int32_t ConnectionManager::SendDataToRemote(const uint32_t &conn_id, const struct iovec *segs,
+                                            const int32_t &seg_count, const uint16_t &data_len) {
+    auto connected_fd = connid2outside_connectionfd_[conn_id];
+    ///payload goes to the socket straight from kcp segment memory
+    struct iovec payload[kMaxPeekSegments];
+    auto payload_count = slice_iovec(segs, seg_count, header_len_, data_len, payload);
+    auto ret = writev(connected_fd, payload, payload_count);
     if (ret < 0) {
-        LOG(ERROR) << "failed to call send to connected_fd:" << connid2outside_connectionfd_[unique_connId] << " error:"
-                   << strerror(errno);
+        LOG(ERROR) << "failed to call writev to connected_fd:" << connected_fd << " error:" << strerror(errno);
         return -1;
     }
     //todo need to handle the issue when ret is less than data length, but this situation will barely happen
-    if (ret != (recv_len_ - header_len_)) {
-        LOG(WARNING) << "failed to send all the data for fd:" << connid2outside_connectionfd_[unique_connId];
+    if (ret != data_len) {
+        LOG(WARNING) << "failed to send all the data for fd:" << connected_fd;
     }
-    recv_len_ = 0;
-    bzero(recv_buf_, sizeof(recv_buf_));
     return 0;
 }
 
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -4,43 +4,118 @@
 
 #include "fec_manager.h"
 #include "kcptunnel_common.h"
+#include "common.h"
+#include <cstring>
+#include <algorithm>
 #include <vector>
 #include <unistd.h>
 #include <glog/logging.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 
 namespace kcptunnel {
 
-FecEncodeManager::FecEncodeManager(std::shared_ptr<connection_info_t> sp_conn,
-                                   std::shared_ptr<FecEncode> sp_fec_encoder)
+namespace {
+
+///kcp segment header, little endian: conv(4) cmd(1) frg(1) wnd(2) ts(4) sn(4) una(4) len(4)
+const int32_t kKcpOverhead = 24;
+const int32_t kKcpCmdOffset = 4;
+const int32_t kKcpLenOffset = 20;
+const uint8_t kKcpCmdPush = 81;
+
+}
+
+template<typename Lock>
+FecEncodeManagerT<Lock>::FecEncodeManagerT(std::shared_ptr<connection_info_t> sp_conn,
+                                           std::shared_ptr<FecEncodeT<Lock>> sp_fec_encoder,
+                                           std::shared_ptr<FecWindowEncodeT<Lock>> sp_window_encoder)
     : sp_conn_(std::move(sp_conn)),
-      sp_fec_encoder_(std::move(sp_fec_encoder)) {}
+      sp_fec_encoder_(std::move(sp_fec_encoder)),
+      sp_window_encoder_(std::move(sp_window_encoder)),
+      control_copies_(0),
+      flush_timer_fd_(-1),
+      flush_deadline_ms_(-1) {}
+
+template<typename Lock>
+void FecEncodeManagerT<Lock>::SetControlCopies(const int32_t &copies) {
+    control_copies_ = copies > 0 ? copies : 0;
+}
+
+template<typename Lock>
+bool FecEncodeManagerT<Lock>::IsControlOnly(const char *data, const int32_t &length) {
+    int32_t offset = 0;
+    while (offset + kKcpOverhead <= length) {
+        if (static_cast<uint8_t>(data[offset + kKcpCmdOffset]) == kKcpCmdPush)
+            return false;
+        const auto *p = reinterpret_cast<const uint8_t *>(data + offset + kKcpLenOffset);
+        const uint32_t seg_len = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        if (seg_len > static_cast<uint32_t>(length - offset - kKcpOverhead))
+            return false;
+        offset += kKcpOverhead + static_cast<int32_t>(seg_len);
+    }
+    ///anything that does not parse as kcp segments is left to the fec groups
+    return offset == length && length > 0;
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::SendControl(const char *data, const int32_t &length) {
+    const size_t pkg_length = sizeof(kFecHeaderMagic) + length;
+    if (control_pkg_.size() < pkg_length)
+        control_pkg_.resize(pkg_length);
+    ///same layout FecDecode takes for unencoded data
+    write_u32_r(control_pkg_.data(), kFecHeaderMagic);
+    memcpy(control_pkg_.data() + sizeof(kFecHeaderMagic), data, length);
+    for (int32_t i = 0; i < control_copies_; ++i) {
+        if (send_data(control_pkg_.data(), static_cast<int32_t>(pkg_length)) < 0)
+            return -4;
+    }
+    return 0;
+}
 
-int32_t FecEncodeManager::Input(const char *data, const int32_t &length) {
-    auto ret = sp_fec_encoder_->Input(data, length);
+template<typename Lock>
+template<typename Encoder>
+int32_t FecEncodeManagerT<Lock>::EncodeAndSend(Encoder *encoder, const char *data, const int32_t &length) {
+    auto ret = encoder->Input(data, length);
     if (ret < 0)
         return -1;
     if (ret == 1) {
-        std::vector<char *> data_pkgs;
-        std::vector<int32_t> data_pkgs_length;
-        ret = sp_fec_encoder_->Output(data_pkgs, data_pkgs_length);
+        ret = encoder->Output(data_pkgs_, data_pkgs_length_);
         if (ret < 0) {
             return -2;
         }
-        const int size = data_pkgs.size();
-        if (size != data_pkgs_length.size())
-            return -3;
-        for (int i = 0; i < size; ++i) {
-            ret = send_data(data_pkgs[i], data_pkgs_length[i]);
-            if (ret < 0) {
-                return -4;
-            }
+        if (SendPkgs() < 0)
+            return -4;
+    }
+    ArmFlushTimer();
+    return 0;
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::Input(const char *data, const int32_t &length) {
+    std::lock_guard<Lock> lck(mutex_);
+    if (control_copies_ > 0 && IsControlOnly(data, length))
+        return SendControl(data, length);
+    if (sp_window_encoder_)
+        return EncodeAndSend(sp_window_encoder_.get(), data, length);
+    return EncodeAndSend(sp_fec_encoder_.get(), data, length);
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::SendPkgs() {
+    const int size = data_pkgs_.size();
+    if (size != data_pkgs_length_.size())
+        return -3;
+    for (int i = 0; i < size; ++i) {
+        auto ret = send_data(data_pkgs_[i], data_pkgs_length_[i]);
+        if (ret < 0) {
+            return -4;
         }
     }
     return 0;
 }
 
-int32_t FecEncodeManager::send_data(const char *data, const int32_t &length) {
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::send_data(const char *data, const int32_t &length) {
     if (sp_conn_->isclient_) {
         LOG(INFO)<<"kcptunnel client send data len:"<<length;
         auto ret = send(sp_conn_->socket_fd_, data, length, 0);
@@ -52,23 +127,97 @@ int32_t FecEncodeManager::send_data(const char *data, const int32_t &length) {
     }
 }
 
-int32_t FecEncodeManager::FlushUnEncodedData() {
-    std::vector<char *> data_pkgs;
-    std::vector<int32_t> data_pkgs_length;
-    sp_fec_encoder_->FlushUnEncodedData(data_pkgs, data_pkgs_length);
-    const int size = data_pkgs.size();
-    if (size != data_pkgs_length.size())
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::FecEncodeUpdateTime(const uint64_t &cur_millsec) {
+    if (sp_window_encoder_)
+        return sp_window_encoder_->FecEncodeUpdateTime(cur_millsec);
+    return sp_fec_encoder_->FecEncodeUpdateTime(cur_millsec);
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::FlushUnEncodedData() {
+    std::lock_guard<Lock> lck(mutex_);
+    return Flush();
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::Flush() {
+    if (sp_window_encoder_)
+        sp_window_encoder_->FlushUnEncodedData(data_pkgs_, data_pkgs_length_);
+    else
+        sp_fec_encoder_->FlushUnEncodedData(data_pkgs_, data_pkgs_length_);
+    auto ret = SendPkgs();
+    if (ret == -3)
+        return -1;
+    return ret < 0 ? -2 : 0;
+}
+
+template<typename Lock>
+void FecEncodeManagerT<Lock>::SetFlushTimer(const int32_t &timer_fd) {
+    std::lock_guard<Lock> lck(mutex_);
+    flush_timer_fd_ = timer_fd;
+    flush_deadline_ms_ = -1;
+}
+
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::ArmFlushTimer() {
+    if (flush_timer_fd_ < 0)
+        return 0;
+    const int64_t deadline = sp_window_encoder_ ? sp_window_encoder_->NextDeadline()
+                                                : sp_fec_encoder_->NextDeadline();
+    ///a timer armed for a later deadline than the encoder has now fires early and is
+    ///simply re-armed by OnFlushTimer, so only an earlier deadline costs a syscall
+    if (deadline < 0 || (flush_deadline_ms_ >= 0 && flush_deadline_ms_ <= deadline))
+        return 0;
+    ///a zero it_value disarms a timerfd, the overdue fire in 1us
+    const int64_t delay_us = std::max<int64_t>((deadline - static_cast<int64_t>(getnowtime_ms())) * 1000, 1);
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    spec.it_value.tv_sec = delay_us / 1000000;
+    spec.it_value.tv_nsec = (delay_us % 1000000) * 1000;
+    if (timerfd_settime(flush_timer_fd_, 0, &spec, nullptr) < 0) {
+        LOG(ERROR) << "failed to arm fec flush timer error:" << strerror(errno);
         return -1;
-    for (int i = 0; i < size; ++i) {
-        auto ret = send_data(data_pkgs[i], data_pkgs_length[i]);
-        if (ret < 0) {
-            return -2;
-        }
     }
+    flush_deadline_ms_ = deadline;
     return 0;
 }
 
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::OnFlushTimer(const uint64_t &cur_millsec) {
+    uint64_t expirations = 0;
+    auto ret = read(flush_timer_fd_, &expirations, sizeof(expirations));
+    if (ret < 0 && errno != EAGAIN)
+        LOG(WARNING) << "failed to read fec flush timer error:" << strerror(errno);
+    std::lock_guard<Lock> lck(mutex_);
+    flush_deadline_ms_ = -1;
+    int32_t flush_ret = 0;
+    if (FecEncodeUpdateTime(cur_millsec) > 0)
+        flush_ret = Flush();
+    ArmFlushTimer();
+    return flush_ret;
 }
 
+template<typename Lock>
+int32_t FecEncodeManagerT<Lock>::SendFeedback(FecDecodeT<Lock> *fec_decoder, const uint64_t &cur_millsec) {
+    char feedback[kFecFeedbackLength];
+    auto length = fec_decoder->Feedback(feedback, kFecFeedbackLength, cur_millsec);
+    if (length <= 0)
+        return length;
+    if (send_data(feedback, length) < 0)
+        return -2;
+    return 0;
+}
+
+template<typename Lock>
+void FecEncodeManagerT<Lock>::OnFeedback(const FecFeedback &feedback) {
+    if (sp_window_encoder_)
+        sp_window_encoder_->OnFeedback(feedback);
+    else
+        sp_fec_encoder_->OnFeedback(feedback);
+}
 
+///the thread safe manager and the one of a single event loop
+template class FecEncodeManagerT<std::mutex>;
+template class FecEncodeManagerT<NullLock>;
 
+}
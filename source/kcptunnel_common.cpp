@@ -189,4 +189,10 @@ int64_t getnowtime_ms() {
     gettimeofday(&tv, nullptr);
     return 1000 * tv.tv_sec + tv.tv_usec / 1000;
 }
+
+int64_t getnowtime_us() {
+    struct timespec ts = {0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000 * static_cast<int64_t>(ts.tv_sec) + ts.tv_nsec / 1000;
+}
 }
@@ -0,0 +1,102 @@
+//
+// Created by lwj on 2020/3/2.
+//
+
+#include "output_pacer.h"
+#include "kcptunnel_common.h"
+#include <algorithm>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <glog/logging.h>
+
+namespace kcptunnel {
+
+OutputPacer::OutputPacer(ikcpcb *kcp, SingleThreadFecEncodeManager *fec_encode_manager, const int32_t &timer_fd,
+                         const size_t &max_queued_pkgs)
+    : max_queued_pkgs_(std::max(max_queued_pkgs, static_cast<size_t>(2))),
+      kcp_(kcp),
+      fec_encode_manager_(fec_encode_manager),
+      timer_fd_(timer_fd),
+      slots_(64) {}
+
+int32_t OutputPacer::Input(const char *data, const int32_t &length) {
+    if (data == nullptr || length <= 0)
+        return -1;
+    ///acks held behind a full window of data would inflate the peer's rtt, they are
+    ///tiny so the bucket is not charged for them either
+    if (SingleThreadFecEncodeManager::IsControlOnly(data, length))
+        return fec_encode_manager_->Input(data, length);
+    if (count_ == slots_.size()) {
+        ///grow the ring, keeping queued packets in order
+        std::vector<std::vector<char>> slots(slots_.size() * 2);
+        for (size_t i = 0; i < count_; ++i)
+            slots[i].swap(slots_[(head_ + i) % slots_.size()]);
+        slots_.swap(slots);
+        head_ = 0;
+    }
+    slots_[(head_ + count_) % slots_.size()].assign(data, data + length);
+    ++count_;
+    ///held kcp still flushes retransmissions, the ring keeps growing for them
+    if (count_ >= max_queued_pkgs_ && !kcp_held_) {
+        ikcp_sndhold(kcp_, 1);
+        kcp_held_ = true;
+    }
+    return Release();
+}
+
+int32_t OutputPacer::OnTimer() {
+    uint64_t expirations = 0;
+    auto ret = read(timer_fd_, &expirations, sizeof(expirations));
+    if (ret < 0 && errno != EAGAIN)
+        LOG(WARNING) << "failed to read pacing timer error:" << strerror(errno);
+    timer_armed_ = false;
+    return Release();
+}
+
+int32_t OutputPacer::Release() {
+    const int64_t now_us = getnowtime_us();
+    const uint32_t rate = ikcp_pacing_rate(kcp_);
+    const int64_t burst = std::max(min_burst_bytes_, static_cast<int64_t>(rate / 500));
+    if (last_refill_us_ == 0)
+        tokens_ = burst;
+    else
+        tokens_ = std::min(static_cast<double>(burst),
+                           tokens_ + static_cast<double>(rate) * (now_us - last_refill_us_) / 1000000);
+    last_refill_us_ = now_us;
+    while (count_ > 0) {
+        std::vector<char> &packet = slots_[head_];
+        ///rate 0 means kcp has no rtt sample yet, nothing to pace against
+        if (rate > 0 && tokens_ < packet.size()) {
+            if (!timer_armed_)
+                return ArmTimer(static_cast<int64_t>((packet.size() - tokens_) * 1000000 / rate) + 1);
+            return 0;
+        }
+        if (rate > 0)
+            tokens_ -= packet.size();
+        auto ret = fec_encode_manager_->Input(packet.data(), static_cast<int32_t>(packet.size()));
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+        if (ret < 0)
+            LOG(WARNING) << "failed to call FecEncodeManager@func Input ret:" << ret;
+        if (kcp_held_ && count_ <= max_queued_pkgs_ / 2) {
+            ///the held data goes out on the next ikcp_update
+            ikcp_sndhold(kcp_, 0);
+            kcp_held_ = false;
+        }
+    }
+    return 0;
+}
+
+int32_t OutputPacer::ArmTimer(const int64_t &delay_us) {
+    struct itimerspec spec = {{0, 0}, {0, 0}};
+    spec.it_value.tv_sec = delay_us / 1000000;
+    spec.it_value.tv_nsec = (delay_us % 1000000) * 1000;
+    if (timerfd_settime(timer_fd_, 0, &spec, nullptr) < 0) {
+        LOG(ERROR) << "failed to arm pacing timer error:" << strerror(errno);
+        return -1;
+    }
+    timer_armed_ = true;
+    return 0;
+}
+
+}
@@ -16,6 +16,22 @@ system_config_t::system_config_t(const std::string &config_file_path) {
         remote_ip.clear();
         listen_port = 0;
         remote_port = 0;
+        congestion_control.clear();
+        fec_xor_parity = false;
+        fec_adaptive = true;
+        fec_interleave = 1;
+        fec_latency_budget_ms = 100;
+        fec_mode = "block";
+        fec_window = 16;
+        fec_window_interval = 4;
+        fec_flush_deadline_ms = 30;
+        fec_small_class_max_length = 128;
+        fec_small_class_deadline_ms = 30;
+        fec_control_copies = 2;
+        fec_data_shards = 2;
+        fec_parity_shards = 1;
+        fec_codec = "rs";
+        fec_crc = false;
         parse_flag = false;
     }
     else{
@@ -74,6 +90,92 @@ int32_t system_config_t::parse_config_json(const std::string &config_file_path)
         rapidjson::Value &remote_port_json = document["remote_port"];
         remote_port = remote_port_json.GetInt();
     }
+    congestion_control = "classic";
+    if (document.HasMember("congestion_control")) {
+        rapidjson::Value &congestion_control_json = document["congestion_control"];
+        congestion_control = std::string(congestion_control_json.GetString());
+    }
+    fec_xor_parity = false;
+    if (document.HasMember("fec_xor_parity")) {
+        rapidjson::Value &fec_xor_parity_json = document["fec_xor_parity"];
+        fec_xor_parity = fec_xor_parity_json.GetBool();
+    }
+    fec_adaptive = true;
+    if (document.HasMember("fec_adaptive")) {
+        rapidjson::Value &fec_adaptive_json = document["fec_adaptive"];
+        fec_adaptive = fec_adaptive_json.GetBool();
+    }
+    fec_interleave = 1;
+    if (document.HasMember("fec_interleave")) {
+        rapidjson::Value &fec_interleave_json = document["fec_interleave"];
+        fec_interleave = fec_interleave_json.GetInt();
+    }
+    fec_latency_budget_ms = 100;
+    if (document.HasMember("fec_latency_budget_ms")) {
+        rapidjson::Value &fec_latency_budget_ms_json = document["fec_latency_budget_ms"];
+        fec_latency_budget_ms = fec_latency_budget_ms_json.GetInt();
+    }
+    fec_mode = "block";
+    if (document.HasMember("fec_mode")) {
+        rapidjson::Value &fec_mode_json = document["fec_mode"];
+        fec_mode = std::string(fec_mode_json.GetString());
+    }
+    fec_window = 16;
+    if (document.HasMember("fec_window")) {
+        rapidjson::Value &fec_window_json = document["fec_window"];
+        fec_window = fec_window_json.GetInt();
+    }
+    fec_window_interval = 4;
+    if (document.HasMember("fec_window_interval")) {
+        rapidjson::Value &fec_window_interval_json = document["fec_window_interval"];
+        fec_window_interval = fec_window_interval_json.GetInt();
+    }
+    fec_flush_deadline_ms = 30;
+    if (document.HasMember("fec_flush_deadline_ms")) {
+        rapidjson::Value &fec_flush_deadline_ms_json = document["fec_flush_deadline_ms"];
+        fec_flush_deadline_ms = fec_flush_deadline_ms_json.GetInt();
+    }
+    fec_small_class_max_length = 128;
+    if (document.HasMember("fec_small_class_max_length")) {
+        rapidjson::Value &fec_small_class_max_length_json = document["fec_small_class_max_length"];
+        fec_small_class_max_length = fec_small_class_max_length_json.GetInt();
+    }
+    fec_small_class_deadline_ms = 30;
+    if (document.HasMember("fec_small_class_deadline_ms")) {
+        rapidjson::Value &fec_small_class_deadline_ms_json = document["fec_small_class_deadline_ms"];
+        fec_small_class_deadline_ms = fec_small_class_deadline_ms_json.GetInt();
+    }
+    fec_control_copies = 2;
+    if (document.HasMember("fec_control_copies")) {
+        rapidjson::Value &fec_control_copies_json = document["fec_control_copies"];
+        fec_control_copies = fec_control_copies_json.GetInt();
+    }
+    fec_data_shards = 2;
+    if (document.HasMember("fec_data_shards")) {
+        rapidjson::Value &fec_data_shards_json = document["fec_data_shards"];
+        fec_data_shards = fec_data_shards_json.GetInt();
+    }
+    fec_parity_shards = 1;
+    if (document.HasMember("fec_parity_shards")) {
+        rapidjson::Value &fec_parity_shards_json = document["fec_parity_shards"];
+        fec_parity_shards = fec_parity_shards_json.GetInt();
+    }
+    ///the fec header keeps 8 bits shard counts
+    if (fec_data_shards < 1 || fec_parity_shards < 1 || fec_data_shards + fec_parity_shards > 255) {
+        LOG(ERROR) << "fec_data_shards and fec_parity_shards must be positive and add up to at most 255";
+        return -1;
+    }
+    fec_codec = "rs";
+    if (document.HasMember("fec_codec")) {
+        rapidjson::Value &fec_codec_json = document["fec_codec"];
+        fec_codec = std::string(fec_codec_json.GetString());
+    }
+    fec_crc = false;
+    if (document.HasMember("fec_crc")) {
+        rapidjson::Value &fec_crc_json = document["fec_crc"];
+        fec_crc = fec_crc_json.GetBool();
+    }
+    return 0;
 }
 
 SystemConfig::SystemConfig(const std::string &config_file_path) : system_config_(config_file_path) {}